@@ -2,6 +2,7 @@
 Includes
 ********************************************************************************/
 #include "usart.h"
+#include "../common/log.h"
 #include <string.h>
 
 /********************************************************************************
@@ -86,8 +87,11 @@ void handle_usart_interrupt() {
 			break;
 
 		default:
-			usart_putchar(usart_data);
-			usart_cmd_buffer[usart_cmd_buffer_count++] = usart_data;
+			// drop what does not fit, the command still runs on Enter
+			if (usart_cmd_buffer_count < sizeof(usart_cmd_buffer)) {
+				usart_putchar(usart_data);
+				usart_cmd_buffer[usart_cmd_buffer_count++] = usart_data;
+			}
 	}
 }
 
@@ -97,8 +101,8 @@ void usart_check_loop() {
 	 * --------> USART Unsupported command received.
 	 */
 	if (GET_REG1_FLAG(usart_reg1_flags, UNSUPPORTED_CMD_RECEIVED)) {
-		printf("<BACKSPACE NOT SUPPORTED>");
-		printf(CONSOLE_PREFIX);
+		log_warn(USART, "<BACKSPACE NOT SUPPORTED>");
+		printf_P(PSTR(CONSOLE_PREFIX));
 		usart_cmd_buffer_count = 0;
 		CLR_REG1_FLAG(usart_reg1_flags, UNSUPPORTED_CMD_RECEIVED);
 	}
@@ -108,7 +112,7 @@ void usart_check_loop() {
 	 */
 	if (GET_REG1_FLAG(usart_reg1_flags, UART_CMD_RECEIVED)) {
 		parse_usart_cmd();
-		printf(CONSOLE_PREFIX);
+		printf_P(PSTR(CONSOLE_PREFIX));
 		usart_cmd_buffer_count = 0;
 		CLR_REG1_FLAG(usart_reg1_flags, UART_CMD_RECEIVED);
 	}
@@ -138,6 +142,9 @@ void parse_usart_cmd() {
 			cmd_args = pch;
 		}
 
-		handle_usart_cmd(cmd, cmd_args);
+		// a line of blanks has no command
+		if (cmd != NULL) {
+			handle_usart_cmd(cmd, cmd_args);
+		}
 	}
 }
@@ -0,0 +1,368 @@
+/*
+ * Radio bootloader, see ota.h for the protocol.
+ *
+ * Polled, no interrupts: the vectors stay with the application.  Built
+ * on its own by boot/Makefile and shares nothing with the application
+ * but ota.h and the Chaskey MAC of common/seal.c.  The radio is wired as
+ * in atmega328.h.
+ */
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/boot.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+
+#include "../common/seal.h"
+#include "../common/util.h"
+#include "../nrf24l01/nRF24L01.h"
+#include "ota.h"
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+#define SPI_CSN PORTB1
+#define SPI_CE  PORTB2
+#define SPI_MOSI PORTB3
+#define SPI_SCK PORTB5
+
+// Where the page at the head of the flash queue stands
+#define FLASH_IDLE		0
+#define FLASH_ERASING	1
+#define FLASH_WRITING	2
+
+/********************************************************************************
+	Global Variables
+********************************************************************************/
+uint8_t pages[2][OTA_PAGE_SIZE];
+uint8_t page_no[2];
+uint8_t queued = 0;				// complete pages not written yet, 0-2
+uint8_t rx_buf = 0;				// buffer the radio fills
+uint8_t flash_buf = 0;			// buffer going to flash
+uint8_t flash_state = FLASH_IDLE;
+uint8_t rx_payloads = 0xff;		// data payloads of the page so far, 0xff before an OTA_PAGE
+uint16_t image_size = 0;
+uint8_t image_tag[OTA_TAG_SIZE];
+bool started = false;
+
+/********************************************************************************
+	Radio
+********************************************************************************/
+static uint8_t spi(uint8_t tx) {
+	SPDR = tx;
+	while (!(SPSR & (1 << SPIF)));
+	return SPDR;
+}
+
+static void radio_write(uint8_t reg, uint8_t value) {
+	_off(SPI_CSN, PORTB);
+	spi(W_REGISTER | reg);
+	spi(value);
+	_on(SPI_CSN, PORTB);
+}
+
+static uint8_t radio_command(uint8_t cmd, uint8_t value) {
+	_off(SPI_CSN, PORTB);
+	spi(cmd);
+	value = spi(value);
+	_on(SPI_CSN, PORTB);
+	return value;
+}
+
+static void radio_init(void) {
+	DDRB |= (1 << SPI_CSN) | (1 << SPI_CE) | (1 << SPI_MOSI) | (1 << SPI_SCK);
+	_on(SPI_CSN, PORTB);
+	SPCR = (1 << SPE) | (1 << MSTR);
+	SPSR = (1 << SPI2X);
+
+	// The radio may still be up from the application
+	_off(SPI_CE, PORTB);
+	radio_write(CONFIG, 0);
+	_delay_ms(5);
+
+	radio_write(SETUP_AW, 3);
+	radio_write(RF_CH, OTA_CHANNEL);
+	radio_write(RF_SETUP, (1 << RF_DR_HIGH) | (3 << RF_PWR_LOW));
+	radio_write(EN_AA, 1 << ENAA_P1);
+	radio_write(EN_RXADDR, 1 << ERX_P1);
+	radio_write(FEATURE, (1 << EN_DPL) | (1 << EN_ACK_PAY));
+	radio_write(DYNPD, 1 << DPL_P1);
+
+	_off(SPI_CSN, PORTB);
+	spi(W_REGISTER | RX_ADDR_P1);
+	for (uint8_t i = 0; i < 5; i++) {
+		spi((uint8_t) (OTA_ADDRESS >> (8 * i)));
+	}
+	_on(SPI_CSN, PORTB);
+
+	radio_command(FLUSH_RX, NOP);
+	radio_command(FLUSH_TX, NOP);
+	radio_write(STATUS, (1 << RX_DR) | (1 << TX_DS) | (1 << MAX_RT));
+	radio_write(CONFIG, (1 << EN_CRC) | (1 << CRCO) | (1 << PWR_UP) | (1 << PRIM_RX));
+	_delay_ms(5);
+	_on(SPI_CE, PORTB);
+}
+
+/**
+ * Reads the next payload into buf, returns its length, 0 if none.
+ */
+static uint8_t radio_read(uint8_t *buf) {
+	if (radio_command(R_REGISTER | FIFO_STATUS, NOP) & (1 << RX_EMPTY)) {
+		return 0;
+	}
+
+	uint8_t len = radio_command(R_RX_PL_WID, NOP);
+	if (len > 32) {
+		radio_command(FLUSH_RX, NOP);
+		return 0;
+	}
+
+	_off(SPI_CSN, PORTB);
+	spi(R_RX_PAYLOAD);
+	for (uint8_t i = 0; i < len; i++) {
+		buf[i] = spi(NOP);
+	}
+	_on(SPI_CSN, PORTB);
+	radio_write(STATUS, 1 << RX_DR);
+
+	return len;
+}
+
+/**
+ * Queues the status for the ack of the next payload, replacing any older one.
+ */
+static void radio_status(uint8_t status) {
+	radio_command(FLUSH_TX, NOP);
+	radio_command(W_ACK_PAYLOAD | 1, status);
+}
+
+/********************************************************************************
+	Flash
+********************************************************************************/
+
+/**
+ * Moves the page at the head of the queue one step on, erase then write,
+ * without waiting for the SPM: the radio is served in between.
+ * The page goes into the temporary buffer before the erase, the erase
+ * leaves it alone.
+ */
+static void flash_poll(void) {
+	uint16_t address = page_no[flash_buf] * OTA_PAGE_SIZE;
+
+	if (boot_spm_busy()) {
+		return;
+	}
+
+	switch (flash_state) {
+	case FLASH_IDLE:
+		if (!queued) {
+			return;
+		}
+		eeprom_busy_wait();
+		for (uint8_t i = 0; i < OTA_PAGE_SIZE; i += 2) {
+			boot_page_fill(address + i, pages[flash_buf][i] | (pages[flash_buf][i + 1] << 8));
+		}
+		boot_page_erase(address);
+		flash_state = FLASH_ERASING;
+		break;
+
+	case FLASH_ERASING:
+		boot_page_write(address);
+		flash_state = FLASH_WRITING;
+		break;
+
+	case FLASH_WRITING:
+		flash_state = FLASH_IDLE;
+		flash_buf ^= 1;
+		queued--;
+		break;
+	}
+}
+
+/**
+ * Checks the tag of the size byte image in the application section
+ * against image_tag, under the node key.  No key, no update.
+ */
+static bool image_verifies(uint16_t size) {
+	seal_key_t key;
+	uint8_t block[16];
+	uint32_t v[4];
+	uint8_t erased = 0xff;
+	uint8_t diff = 0;
+
+	eeprom_read_block(block, SEAL_EE_KEY, SEAL_KEY_SIZE);
+	for (uint8_t i = 0; i < SEAL_KEY_SIZE; i++) {
+		erased &= block[i];
+	}
+	if (erased == 0xff) {
+		return false;
+	}
+	seal_init(&key, block);
+
+	// The first block holds the size, and 2 where frame tags and the key
+	// stream have 1 and 0, so no frame can pass for an image
+	memset(block, 0, sizeof block);
+	block[0] = size;
+	block[1] = size >> 8;
+	block[4] = OTA_TAG_DOMAIN;
+	seal_mac_start(&key, v);
+	seal_mac_block(v, block);
+
+	boot_rww_enable();
+	uint16_t i = 0;
+	for (;;) {
+		uint8_t len = size - i > 16 ? 16 : size - i;
+		for (uint8_t j = 0; j < len; j++) {
+			block[j] = pgm_read_byte(i + j);
+		}
+		i += len;
+		if (i == size) {
+			seal_mac_finish(&key, v, block, len);
+			break;
+		}
+		seal_mac_block(v, block);
+	}
+
+	// Compare every byte, the time taken must not tell how many matched
+	for (uint8_t j = 0; j < OTA_TAG_SIZE; j++) {
+		diff |= ((uint8_t *) v)[j] ^ image_tag[j];
+	}
+	memset(&key, 0, sizeof key);
+
+	return !diff;
+}
+
+/********************************************************************************
+	Protocol
+********************************************************************************/
+
+/**
+ * Handles one payload from the gateway, returns true once the image verified.
+ */
+static bool handle(uint8_t *buf, uint8_t len) {
+	if (len == 32) {
+		if (rx_payloads >= OTA_PAGE_PAYLOADS) {
+			return false;
+		}
+		for (uint8_t i = 0; i < 32; i++) {
+			pages[rx_buf][rx_payloads * 32 + i] = buf[i];
+		}
+		if (++rx_payloads == OTA_PAGE_PAYLOADS) {
+			queued++;
+			rx_buf ^= 1;
+		}
+		return false;
+	}
+
+	switch (buf[0]) {
+	case OTA_START:
+		if (len < 3 + OTA_TAG_SIZE) {
+			break;
+		}
+		image_size = buf[1] | (buf[2] << 8);
+		memcpy(image_tag, buf + 3, OTA_TAG_SIZE);
+		if (!image_size || image_size > OTA_BOOT_START) {
+			radio_status(OTA_STATUS_TOO_BIG);
+			break;
+		}
+		// No EEPROM write while the SPM works
+		boot_spm_busy_wait();
+		eeprom_update_byte(OTA_EE_FLAG, OTA_FLAG_WRITING);
+		radio_status(OTA_STATUS_OK);
+		started = true;
+		break;
+
+	case OTA_PAGE:
+		// A page the gateway sends again starts over
+		if (started && len >= 2 && buf[1] < OTA_APP_PAGES) {
+			page_no[rx_buf] = buf[1];
+			rx_payloads = 0;
+		}
+		break;
+
+	case OTA_FINISH:
+		if (!started) {
+			break;
+		}
+		while (queued) {
+			flash_poll();
+		}
+		boot_spm_busy_wait();
+		if (!image_verifies(image_size)) {
+			radio_status(OTA_STATUS_BAD_TAG);
+			break;
+		}
+		eeprom_update_byte(OTA_EE_FLAG, 0xff);
+		radio_status(OTA_STATUS_OK);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Receives an image until one verifies, or until OTA_WAIT_OVERFLOWS
+ * without an OTA_START when the application is still whole.
+ */
+static void update(void) {
+	uint8_t buf[32];
+	uint8_t overflows = 0;
+
+	radio_init();
+	TCCR1A = 0;
+	TCCR1B = (1 << CS12) | (1 << CS10);
+
+	while (1) {
+		flash_poll();
+
+		if (!started && (TIFR1 & (1 << TOV1))) {
+			TIFR1 = 1 << TOV1;
+			if (++overflows >= OTA_WAIT_OVERFLOWS && eeprom_read_byte(OTA_EE_FLAG) == OTA_FLAG_UPDATE) {
+				eeprom_update_byte(OTA_EE_FLAG, 0xff);
+				break;
+			}
+		}
+
+		// A page is still being filled, or the buffer it goes to is free
+		if (queued == 2) {
+			continue;
+		}
+		uint8_t len = radio_read(buf);
+		if (len && handle(buf, len)) {
+			break;
+		}
+	}
+
+	// Let the last ack payload go out, then start over from a clean reset
+	for (uint8_t i = 0; i < 100 && !(radio_command(R_REGISTER | FIFO_STATUS, NOP) & (1 << TX_EMPTY)); i++) {
+		_delay_ms(10);
+	}
+	radio_write(CONFIG, 0);
+	eeprom_busy_wait();
+	wdt_enable(WDTO_15MS);
+	while (1);
+}
+
+/********************************************************************************
+	Main
+********************************************************************************/
+int main(void) {
+	// The watchdog stays on after it reset us, WDRF holds it on.  The
+	// application finds the other reset flags as they were.
+	MCUSR &= ~(1 << WDRF);
+	wdt_disable();
+
+	uint8_t flag = eeprom_read_byte(OTA_EE_FLAG);
+	if (flag == OTA_FLAG_UPDATE || flag == OTA_FLAG_WRITING || pgm_read_word(0) == 0xffff) {
+		update();
+	}
+
+	((void (*)(void)) 0)();
+	return 0;
+}
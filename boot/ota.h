@@ -0,0 +1,96 @@
+#ifndef OTA_H_
+#define OTA_H_
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdint.h>
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+/*
+ * Firmware update over the radio, received by the bootloader in boot/.
+ *
+ * The application asks for an update by writing OTA_FLAG_UPDATE to the
+ * last EEPROM byte and resetting through the watchdog.  It does so only in
+ * a build with sealed frames, and only for an OTA setting that came in a
+ * sealed ack payload, see handleDownlink() in main.cpp.  The bootloader
+ * then listens as PRX on OTA_CHANNEL at 2MBPS, 16 bit CRC, dynamic payloads
+ * and auto ack, on the node's own address, and the gateway streams the image:
+ *
+ *	{OTA_START, size_lo, size_hi, tag[OTA_TAG_SIZE]}
+ *	{OTA_PAGE, page}, then OTA_PAGE_PAYLOADS payloads of 32 data bytes
+ *	... one OTA_PAGE and its data for every page of the image
+ *	{OTA_FINISH}
+ *	{OTA_POLL} until an ack payload {status} comes back
+ *
+ * Only data payloads are 32 bytes long.  A page that lost a payload to
+ * MAX_RT is sent again from its OTA_PAGE.  ESB drops duplicates and keeps
+ * the order, so the payloads after an OTA_PAGE are that page, in order.
+ *
+ * The bootloader runs from the NRWW section and keeps draining the radio
+ * while the application section is erased and written: a page is
+ * assembled in one RAM buffer while the other one goes to flash.  When
+ * both are full it stops reading, the RX FIFO fills and the radio no
+ * longer acks, so the gateway's retries are the flow control.  Its ARD
+ * times ARC must outlast a page erase and write, OTA_GATEWAY_ARD_US at 15
+ * retries does.
+ *
+ * The flash, not the link, sets the pace: a page erase and write takes
+ * OTA_PAGE_US, 2MBPS ESB moves the page in about 3ms.  Receiving the next
+ * page while the last one is written hides the link time, the update
+ * runs at the flash's 14KB/s until losses make the link the slower one;
+ * rf24bench compares it with receiving and writing in turn.
+ *
+ * OTA_FINISH checks the tag of the whole image, only then the flag goes
+ * back to erased and the node resets into the new application.  The tag
+ * is the first OTA_TAG_SIZE bytes of Chaskey under the node key, the one
+ * at SEAL_EE_KEY that seals the frames (common/seal.h), over
+ *
+ *	{size_lo, size_hi, 0, 0, OTA_TAG_DOMAIN, 0 x 11}, image
+ *
+ * A node without a key takes no image.  The tag does not stop an older
+ * image signed with the same key from going in again.  A node
+ * that loses power or the gateway half way stays in the bootloader with
+ * OTA_FLAG_WRITING until an image verifies.
+ */
+#define OTA_CHANNEL			110
+#define OTA_ADDRESS			0xF0F0F0F0D2LL		// the node's own, RX pipe 1
+#define OTA_PAGE_SIZE		128					// SPM_PAGESIZE of the ATmega328P
+#define OTA_PAGE_PAYLOADS	(OTA_PAGE_SIZE / 32)
+#define OTA_PAGE_US			9000				// page erase and write, 4.5ms each at worst
+#define OTA_GATEWAY_ARD_US	1000
+
+// Bootloader at the start of a 1024 word boot section, BOOTSZ1:0 = 01 and
+// BOOTRST programmed, everything below is the application's
+#define OTA_BOOT_START		0x7800
+#define OTA_APP_PAGES		(OTA_BOOT_START / OTA_PAGE_SIZE)
+
+// Messages from the gateway, the first byte of the payload
+#define OTA_START			1
+#define OTA_PAGE			2
+#define OTA_FINISH			3
+#define OTA_POLL			4
+
+// Ack payload after OTA_START and OTA_FINISH
+#define OTA_STATUS_OK		0
+#define OTA_STATUS_TOO_BIG	1
+#define OTA_STATUS_BAD_TAG	2
+
+#define OTA_TAG_SIZE		8
+#define OTA_TAG_DOMAIN		2	// frame tags have 1 there, the key stream 0
+
+// Last EEPROM byte, erased (0xff) runs the application
+#define OTA_EE_FLAG			((uint8_t *) 0x3ff)
+#define OTA_FLAG_UPDATE		0x5a	// application asked for an update
+#define OTA_FLAG_WRITING	0x00	// application section partly written
+
+// The bootloader goes back to the application after this many Timer1
+// overflows, 8.4s each, without an OTA_START
+#define OTA_WAIT_OVERFLOWS	4
+
+// Downlink setting that sends the node into the bootloader, with this value
+#define OTA_DOWNLINK_MAGIC	0x0a7a
+
+#endif /* OTA_H_ */
@@ -0,0 +1,45 @@
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <avr/io.h>
+
+#include "log.h"
+
+/********************************************************************************
+	Global Variables
+********************************************************************************/
+static uint16_t log_window_start = 0;
+static uint8_t log_lines = 0;
+static uint16_t log_dropped = 0;
+
+/********************************************************************************
+	Functions
+********************************************************************************/
+/*
+ * Token bucket of LOG_BURST lines refilled every LOG_WINDOW_TICKS of Timer1.
+ * Timer1 wraps every 8.4s and stops in power-save, so a window can last
+ * longer than a second, never shorter.
+ */
+bool log_allow(void) {
+	uint16_t now = TCNT1;
+
+	if ((uint16_t) (now - log_window_start) >= LOG_WINDOW_TICKS) {
+		log_window_start = now;
+		log_lines = 0;
+		if (log_dropped) {
+			log_lines++;
+			printf_P(PSTR("\n(%u log lines dropped)"), log_dropped);
+			log_dropped = 0;
+		}
+	}
+
+	if (log_lines >= LOG_BURST) {
+		if (log_dropped < 0xffff) {
+			log_dropped++;
+		}
+		return false;
+	}
+
+	log_lines++;
+	return true;
+}
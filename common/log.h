@@ -0,0 +1,77 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdbool.h>
+#include <stdio.h>
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#endif
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+/*
+ * Console logging with a compile time level per module.
+ *
+ *   log_debug(RADIO, "write_register(%02x,%02x)", reg, value);
+ *
+ * prints "\nRADIO: write_register(07,0e)" when LOG_LEVEL_RADIO is LOG_DEBUG
+ * or higher.  Below that the level test is a constant, the call, its
+ * arguments and its format all compile away.  Formats stay in flash, a
+ * string argument from flash needs %S.
+ *
+ * Set a module's level with -DLOG_LEVEL_<module>=<level>.  The UART blocks
+ * for 2ms per character at 4800 baud, so lines that get through are rate
+ * limited: at most LOG_BURST per LOG_WINDOW_TICKS, the rest are dropped
+ * and counted.
+ */
+#define LOG_NONE	0
+#define LOG_ERROR	1
+#define LOG_WARN	2
+#define LOG_INFO	3
+#define LOG_DEBUG	4
+
+#ifndef LOG_LEVEL_RADIO
+#define LOG_LEVEL_RADIO LOG_WARN	// RF24 driver
+#endif
+#ifndef LOG_LEVEL_SENSOR
+#define LOG_LEVEL_SENSOR LOG_WARN	// DHT and DS18x20
+#endif
+#ifndef LOG_LEVEL_USART
+#define LOG_LEVEL_USART LOG_WARN	// console
+#endif
+#ifndef LOG_LEVEL_APP
+#define LOG_LEVEL_APP LOG_WARN		// main.cpp
+#endif
+
+#define LOG_BURST 8
+#define LOG_WINDOW_TICKS 7813		// one second of Timer1 at clk/1024, while awake
+
+#define log_print(module, level, fmt, ...) \
+			do { \
+				if (LOG_LEVEL_##module >= (level) && log_allow()) \
+					printf_P(PSTR("\n" #module ": " fmt), ##__VA_ARGS__); \
+			} while (0)
+
+#define log_error(module, fmt, ...)	log_print(module, LOG_ERROR, fmt, ##__VA_ARGS__)
+#define log_warn(module, fmt, ...)	log_print(module, LOG_WARN, fmt, ##__VA_ARGS__)
+#define log_info(module, fmt, ...)	log_print(module, LOG_INFO, fmt, ##__VA_ARGS__)
+#define log_debug(module, fmt, ...)	log_print(module, LOG_DEBUG, fmt, ##__VA_ARGS__)
+
+/********************************************************************************
+	Function Prototypes
+********************************************************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool log_allow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_H_ */
@@ -0,0 +1,212 @@
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <string.h>
+
+#include "seal.h"
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (32 - (b))))
+
+// Longest data that still fits a 32 byte frame once sealed
+#define SEAL_MAX_DATA (32 - SEAL_HEADER_SIZE - SEAL_OVERHEAD)
+
+/********************************************************************************
+	Functions
+********************************************************************************/
+
+/**
+ * The Chaskey permutation, SEAL_ROUNDS rounds.
+ */
+static void permute(uint32_t *v) {
+	uint32_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+	for (uint8_t i = 0; i < SEAL_ROUNDS; i++) {
+		v0 += v1; v1 = ROTL(v1, 5); v1 ^= v0; v0 = ROTL(v0, 16);
+		v2 += v3; v3 = ROTL(v3, 8); v3 ^= v2;
+		v0 += v3; v3 = ROTL(v3, 13); v3 ^= v0;
+		v2 += v1; v1 = ROTL(v1, 7); v1 ^= v2; v2 = ROTL(v2, 16);
+	}
+
+	v[0] = v0;
+	v[1] = v1;
+	v[2] = v2;
+	v[3] = v3;
+}
+
+/**
+ * out = 2 * in in GF(2^128) mod x^128 + x^7 + x^2 + x + 1.
+ */
+static void times_two(uint32_t *out, const uint32_t *in) {
+	out[0] = (in[0] << 1) ^ ((in[3] >> 31) ? 0x87 : 0);
+	out[1] = (in[1] << 1) | (in[0] >> 31);
+	out[2] = (in[2] << 1) | (in[1] >> 31);
+	out[3] = (in[3] << 1) | (in[2] >> 31);
+}
+
+static void xor_words(uint32_t *v, const uint32_t *m) {
+	v[0] ^= m[0];
+	v[1] ^= m[1];
+	v[2] ^= m[2];
+	v[3] ^= m[3];
+}
+
+static void put_counter(uint8_t *buf, uint32_t counter) {
+	buf[0] = counter;
+	buf[1] = counter >> 8;
+	buf[2] = counter >> 16;
+	buf[3] = counter >> 24;
+}
+
+/**
+ * Derives the subkeys from the 16 byte node key.
+ * Words are little endian, like the byte order of the AVR.
+ */
+void seal_init(seal_key_t *key, const uint8_t *node_key) {
+	memcpy(key->k, node_key, sizeof key->k);
+	times_two(key->k1, key->k);
+	times_two(key->k2, key->k1);
+}
+
+/**
+ * Chaskey of a message of any length, for one longer than seal_mac()
+ * takes: seal_mac_start() sets up the state v, seal_mac_block() takes
+ * every 16 byte block but the last, seal_mac_finish() the last 1 to 16
+ * bytes and leaves the 16 byte result in v.
+ */
+void seal_mac_start(const seal_key_t *key, uint32_t *v) {
+	memcpy(v, key->k, sizeof key->k);
+}
+
+void seal_mac_block(uint32_t *v, const uint8_t *block) {
+	uint32_t m[4];
+
+	memcpy(m, block, sizeof m);
+	xor_words(v, m);
+	permute(v);
+}
+
+void seal_mac_finish(const seal_key_t *key, uint32_t *v, const uint8_t *last, uint8_t len) {
+	uint32_t m[4];
+	const uint32_t *last_key;
+
+	// The last block, complete or padded with 0x01 and zeros
+	memset(m, 0, sizeof m);
+	memcpy(m, last, len);
+	if (len == 16) {
+		last_key = key->k1;
+	} else {
+		((uint8_t *) m)[len] = 0x01;
+		last_key = key->k2;
+	}
+	xor_words(v, m);
+	xor_words(v, last_key);
+	permute(v);
+	xor_words(v, last_key);
+}
+
+/**
+ * Chaskey of len bytes at msg, the 16 byte result goes to tag.
+ */
+void seal_mac(const seal_key_t *key, const uint8_t *msg, uint8_t len, uint8_t *tag) {
+	uint32_t v[4];
+
+	seal_mac_start(key, v);
+	for (; len > 16; msg += 16, len -= 16) {
+		seal_mac_block(v, msg);
+	}
+	seal_mac_finish(key, v, msg, len);
+
+	memcpy(tag, v, sizeof v);
+}
+
+/**
+ * XORs the key stream into len bytes of data.
+ */
+static void crypt(const seal_key_t *key, uint8_t *data, uint8_t len, uint32_t counter) {
+	uint8_t block[16];
+
+	for (uint8_t i = 0; i * 16 < len; i++) {
+		put_counter(block, counter);
+		block[4] = 0;
+		block[5] = i;
+		seal_mac(key, block, 6, block);
+
+		for (uint8_t j = 0; j < 16 && i * 16 + j < len; j++) {
+			data[i * 16 + j] ^= block[j];
+		}
+	}
+}
+
+/**
+ * Tag of the header, the counter and len bytes of ciphertext.
+ */
+static void tag_of(const seal_key_t *key, const uint8_t *header, const uint8_t *data, uint8_t len,
+		uint32_t counter, uint8_t *tag) {
+	uint8_t msg[8 + SEAL_MAX_DATA];
+
+	put_counter(msg, counter);
+	msg[4] = 1;
+	memcpy(msg + 5, header, SEAL_HEADER_SIZE);
+	memcpy(msg + 8, data, len);
+	seal_mac(key, msg, 8 + len, msg);
+
+	memcpy(tag, msg, SEAL_TAG_SIZE);
+}
+
+/**
+ * Seals the len byte frame in place, it must have room for SEAL_OVERHEAD
+ * more bytes, 32 in all at most.  counter must not have been used with
+ * this key before.
+ * Returns the sealed length.
+ */
+uint8_t seal(const seal_key_t *key, uint8_t *frame, uint8_t len, uint32_t counter) {
+	uint8_t *data = frame + SEAL_HEADER_SIZE + SEAL_COUNTER_SIZE;
+	uint8_t data_len = len - SEAL_HEADER_SIZE;
+
+	memmove(data, frame + SEAL_HEADER_SIZE, data_len);
+	frame[2] |= SEAL_MSG_FLAG;
+	put_counter(frame + SEAL_HEADER_SIZE, counter);
+
+	crypt(key, data, data_len, counter);
+	tag_of(key, frame, data, data_len, counter, data + data_len);
+
+	return len + SEAL_OVERHEAD;
+}
+
+/**
+ * Checks and decrypts a sealed frame in place, leaving the frame as it
+ * was before seal().  The caller must still check counter is above the
+ * last one accepted from the node.
+ * Returns the plain length, -1 if the frame is not sealed or was altered.
+ */
+int8_t seal_open(const seal_key_t *key, uint8_t *frame, uint8_t len, uint32_t *counter) {
+	uint8_t *data = frame + SEAL_HEADER_SIZE + SEAL_COUNTER_SIZE;
+	uint8_t tag[SEAL_TAG_SIZE];
+	uint8_t diff = 0;
+
+	if (len < SEAL_HEADER_SIZE + SEAL_OVERHEAD || len > 32 || !(frame[2] & SEAL_MSG_FLAG)) {
+		return -1;
+	}
+
+	uint8_t data_len = len - SEAL_HEADER_SIZE - SEAL_OVERHEAD;
+	const uint8_t *c = frame + SEAL_HEADER_SIZE;
+	*counter = c[0] | ((uint32_t) c[1] << 8) | ((uint32_t) c[2] << 16) | ((uint32_t) c[3] << 24);
+
+	// Compare every byte, the time taken must not tell how many matched
+	tag_of(key, frame, data, data_len, *counter, tag);
+	for (uint8_t i = 0; i < SEAL_TAG_SIZE; i++) {
+		diff |= tag[i] ^ data[data_len + i];
+	}
+	if (diff) {
+		return -1;
+	}
+
+	crypt(key, data, data_len, *counter);
+	memmove(frame + SEAL_HEADER_SIZE, data, data_len);
+	frame[2] &= ~SEAL_MSG_FLAG;
+
+	return SEAL_HEADER_SIZE + data_len;
+}
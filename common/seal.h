@@ -0,0 +1,84 @@
+#ifndef SEAL_H_
+#define SEAL_H_
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+/*
+ * Authenticated encryption of radio frames.
+ *
+ * Built on Chaskey-12, an ARX MAC for 8 to 32 bit microcontrollers: a
+ * 128 bit state of four 32 bit words, 12 rounds of add, rotate and xor,
+ * no tables.  Most of its rotations are by 8 or 16, byte moves on the
+ * AVR.  One permutation handles 16 bytes, where a 64 bit block cipher
+ * needs two block encryptions, one to encrypt and one for the MAC.
+ *
+ * A sealed frame keeps its SEAL_HEADER_SIZE byte header in clear, with
+ * SEAL_MSG_FLAG set in the message type, then the frame counter, the
+ * encrypted data and the tag:
+ *
+ *	{100, node, type | SEAL_MSG_FLAG}, uint32 counter, data, tag
+ *
+ * The data is XORed with the key stream Chaskey(K, {counter, 0, i}),
+ * 16 bytes per block i.  The tag is Chaskey(K, {counter, 1, header,
+ * ciphertext}) cut to SEAL_TAG_SIZE bytes, encrypt then MAC.  The byte
+ * after the counter keeps the two kinds of input apart.
+ *
+ * The counter must never repeat under one key: the node reserves blocks of
+ * counters in EEPROM, the gateway accepts a counter only above the last
+ * one it took from that node, which also rejects replays.  Frames the
+ * gateway seals to the node take their counters from SEAL_DOWNLINK up,
+ * the node's own stay below.
+ *
+ * Cost: ceil(data / 16) + ceil((data + 8) / 16) permutations, 4 for the 21
+ * bytes of data left in a full sealed frame.
+ */
+#define SEAL_HEADER_SIZE	3
+#define SEAL_COUNTER_SIZE	4
+#define SEAL_TAG_SIZE		4
+#define SEAL_OVERHEAD		(SEAL_COUNTER_SIZE + SEAL_TAG_SIZE)
+#define SEAL_MSG_FLAG		0x80
+#define SEAL_KEY_SIZE		16
+#define SEAL_ROUNDS			12
+#define SEAL_DOWNLINK		0x80000000UL
+
+// Node key, at a fixed EEPROM address so the bootloader finds it too,
+// see boot/ota.h.  Written once when the node is provisioned.
+#define SEAL_EE_KEY			((uint8_t *) (0x3ff - SEAL_KEY_SIZE))
+
+// What sealing a full 32 byte frame may add to a report, checked by the
+// "seal" console command on a node
+#define SEAL_BUDGET_US		1000
+
+typedef struct {
+	uint32_t k[4];		// node key
+	uint32_t k1[4];		// 2K in GF(2^128), for a complete last block
+	uint32_t k2[4];		// 4K, for a padded one
+} seal_key_t;
+
+/********************************************************************************
+	Function Prototypes
+********************************************************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void seal_init(seal_key_t *key, const uint8_t *node_key);
+void seal_mac(const seal_key_t *key, const uint8_t *msg, uint8_t len, uint8_t *tag);
+void seal_mac_start(const seal_key_t *key, uint32_t *v);
+void seal_mac_block(uint32_t *v, const uint8_t *block);
+void seal_mac_finish(const seal_key_t *key, uint32_t *v, const uint8_t *last, uint8_t len);
+uint8_t seal(const seal_key_t *key, uint8_t *frame, uint8_t len, uint32_t counter);
+int8_t seal_open(const seal_key_t *key, uint8_t *frame, uint8_t len, uint32_t *counter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEAL_H_ */
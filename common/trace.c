@@ -0,0 +1,61 @@
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <util/crc16.h>
+
+#include "trace.h"
+
+/********************************************************************************
+	Global Variables
+********************************************************************************/
+trace_record_t trace_ring[TRACE_SIZE];
+volatile uint16_t trace_seq = 0;
+volatile uint8_t trace_frozen = 0;
+
+/********************************************************************************
+	Functions
+********************************************************************************/
+
+static void put_byte(void (*put)(char), uint16_t *crc, uint8_t value) {
+	*crc = _crc16_update(*crc, value);
+	put((char) value);
+}
+
+static void put_word(void (*put)(char), uint16_t *crc, uint16_t value) {
+	put_byte(put, crc, value);
+	put_byte(put, crc, value >> 8);
+}
+
+/**
+ * Sends the ring, oldest record first, in the format described in trace.h.
+ * Recording is suspended while the bytes go out, 32 records take 0.4s at
+ * 4800 baud.
+ */
+void trace_dump(void (*put)(char)) {
+	uint16_t crc = 0xffff;
+
+	trace_frozen = 1;
+
+	uint16_t seq = trace_seq;
+	uint8_t n = seq < TRACE_SIZE ? seq : TRACE_SIZE;
+
+	put('T');
+	put('R');
+	put('C');
+	put('1');
+	put_byte(put, &crc, TRACE_SIZE);
+	put_word(put, &crc, seq);
+	put_word(put, &crc, TCNT1);
+	put_byte(put, &crc, n);
+
+	for (uint8_t i = 0; i < n; i++) {
+		const trace_record_t *r = &trace_ring[(uint8_t) (seq - n + i) & (TRACE_SIZE - 1)];
+		put_word(put, &crc, r->time);
+		put_byte(put, &crc, r->id);
+		put_word(put, &crc, r->arg);
+	}
+	put((char) crc);
+	put((char) (crc >> 8));
+
+	trace_frozen = 0;
+}
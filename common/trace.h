@@ -0,0 +1,92 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdint.h>
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+
+#include "trace_events.h"
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+/*
+ * Binary event trace.
+ *
+ * trace(TRACE_RF_TX, len) stores {Timer1 tick, id, arg} in a RAM ring of
+ * TRACE_SIZE records, oldest overwritten first.  It is safe from ISRs and
+ * costs a few dozen cycles, so it stays on in production builds; the
+ * console "trace" command sends the ring with trace_dump() and
+ * host/tracedump turns it into a timeline.
+ *
+ * Timestamps are Timer1 ticks of 128us.  Timer1 stops in power-save and
+ * wraps every 8.4s, the decoder unwraps them assuming less than that
+ * between two records; TRACE_WAKE marks each Timer 2 wakeup.
+ *
+ * Dump, little endian:
+ *	"TRC1", uint8 ring size, uint16 records ever written, uint16 tick now,
+ *	uint8 n, n * { uint16 tick, uint8 id, uint16 arg } oldest first,
+ *	uint16 CRC-16 (_crc16_update, 0xffff) over everything after the magic
+ */
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 32	// records of 5 bytes, a power of two up to 128
+#endif
+
+#define TRACE_ID(name, doc) TRACE_##name,
+enum { TRACE_EVENTS(TRACE_ID) TRACE_EVENT_COUNT };
+#undef TRACE_ID
+
+typedef struct {
+	uint16_t time;
+	uint8_t id;
+	uint16_t arg;
+} trace_record_t;
+
+/********************************************************************************
+	Global Variables
+********************************************************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern trace_record_t trace_ring[TRACE_SIZE];
+extern volatile uint16_t trace_seq;		// records ever written
+extern volatile uint8_t trace_frozen;	// set while dumping
+
+/********************************************************************************
+	Function Prototypes
+********************************************************************************/
+void trace_dump(void (*put)(char));
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline void trace(uint8_t id, uint16_t arg) {
+#if TRACE_ENABLE && defined(__AVR__)
+	uint8_t sreg = SREG;
+	cli();
+	if (!trace_frozen) {
+		trace_record_t *r = &trace_ring[(uint8_t) trace_seq & (TRACE_SIZE - 1)];
+		trace_seq++;
+		r->time = TCNT1;
+		r->id = id;
+		r->arg = arg;
+	}
+	SREG = sreg;
+#else
+	(void) id;
+	(void) arg;
+#endif
+}
+
+#endif /* TRACE_H_ */
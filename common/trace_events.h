@@ -0,0 +1,29 @@
+#ifndef TRACE_EVENTS_H_
+#define TRACE_EVENTS_H_
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+/*
+ * Trace event ids, shared with the host decoder (host/tracedump.cpp).
+ * Append only, the position in the list is the id in the dump.
+ *
+ *	X(name, meaning of the 16 bit argument)
+ */
+#define TRACE_EVENTS(X) \
+	X(BOOT,			"MCUSR reset flags") \
+	X(WAKE,			"Timer 2 wakeups since the last sample") \
+	X(SAMPLE,		"temperature, 1/10 C") \
+	X(SEND,			"samples in the frame") \
+	X(DELIVERY,		"delivered | failed sends before it << 8") \
+	X(CHANNEL,		"channel moved to") \
+	X(DOWNLINK,		"accepted | param << 8") \
+	X(RF_STATE,		"rf24_state_e entered") \
+	X(RF_TX,		"payload bytes") \
+	X(RF_DONE,		"tx_ok | tx_fail << 1 | ack payload << 2") \
+	X(RF_IRQ,		"-") \
+	X(RF_RESTORE,	"verified") \
+	X(DHT_READ,		"-") \
+	X(DHT_DONE,		"0 ok, 1/2 no start pulse, 3 bit timeout, 4 checksum | bit << 8")
+
+#endif /* TRACE_EVENTS_H_ */
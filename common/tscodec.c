@@ -0,0 +1,92 @@
+/********************************************************************************
+	Includes
+********************************************************************************/
+
+#include "tscodec.h"
+
+/********************************************************************************
+	Functions
+********************************************************************************/
+
+static uint16_t zigzag(int16_t value) {
+	return ((uint16_t) value << 1) ^ (uint16_t) (value >> 15);
+}
+
+/**
+ * Nibbles needed for the zigzag varint of value, 1 to 6.
+ */
+static uint8_t varint_nibbles(uint16_t value) {
+	uint8_t n = 1;
+
+	while (value > 7) {
+		value >>= 3;
+		n++;
+	}
+	return n;
+}
+
+static void put_nibble(ts_encoder_t *enc, uint8_t nibble) {
+	uint8_t *p = enc->buf + (enc->nibbles >> 1);
+
+	if (enc->nibbles & 1) {
+		*p |= nibble;
+	} else {
+		*p = nibble << 4;
+	}
+	enc->nibbles++;
+}
+
+/**
+ * Starts a new frame in buf, size bytes long.
+ */
+void ts_encoder_init(ts_encoder_t *enc, uint8_t *buf, uint8_t size) {
+	enc->buf = buf;
+	enc->size = size;
+	enc->nibbles = 0;
+	enc->count = 0;
+}
+
+/**
+ * Appends one sample of channels values.  Either the whole sample fits
+ * or nothing is written and false is returned.
+ */
+bool ts_encode(ts_encoder_t *enc, const int16_t *values, uint8_t channels) {
+	uint16_t coded[TS_MAX_CHANNELS];
+	uint8_t needed = 0;
+	uint8_t i;
+
+	if (channels > TS_MAX_CHANNELS) {
+		return false;
+	}
+
+	for (i = 0; i < channels; i++) {
+		int16_t value = enc->count ? values[i] - enc->last[i] : values[i];
+		coded[i] = zigzag(value);
+		needed += varint_nibbles(coded[i]);
+	}
+
+	if (enc->nibbles + needed > 2 * enc->size) {
+		return false;
+	}
+
+	for (i = 0; i < channels; i++) {
+		uint16_t value = coded[i];
+
+		while (value > 7) {
+			put_nibble(enc, 0x08 | (value & 0x07));
+			value >>= 3;
+		}
+		put_nibble(enc, value);
+		enc->last[i] = values[i];
+	}
+	enc->count++;
+
+	return true;
+}
+
+/**
+ * Bytes taken by the samples encoded so far.
+ */
+uint8_t ts_encoded_length(const ts_encoder_t *enc) {
+	return (enc->nibbles + 1) >> 1;
+}
@@ -0,0 +1,41 @@
+#ifndef TSCODEC_H_
+#define TSCODEC_H_
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+/*
+ * Time series codec for sensor samples.
+ *
+ * A sample is one int16 value per channel.  The first sample of a frame is
+ * sent as is, every later one as the difference to the previous sample of
+ * the same channel.  Each value is zigzag mapped (0, -1, 1, -2, ... become
+ * 0, 1, 2, 3, ...) and written as a nibble varint: 3 data bits per nibble,
+ * least significant first, the high bit of a nibble set when another one
+ * follows.  Deltas of -4..3 take one nibble, -32..31 two.  Nibbles fill a
+ * byte high nibble first, an odd count leaves a zero low nibble at the end.
+ */
+#define TS_MAX_CHANNELS 2
+
+typedef struct {
+	uint8_t *buf;
+	uint8_t size;		// capacity in bytes
+	uint8_t nibbles;	// nibbles written so far
+	uint8_t count;		// samples written so far
+	int16_t last[TS_MAX_CHANNELS];
+} ts_encoder_t;
+
+/********************************************************************************
+	Function Prototypes
+********************************************************************************/
+void ts_encoder_init(ts_encoder_t *enc, uint8_t *buf, uint8_t size);
+bool ts_encode(ts_encoder_t *enc, const int16_t *values, uint8_t channels);
+uint8_t ts_encoded_length(const ts_encoder_t *enc);
+
+#endif /* TSCODEC_H_ */
@@ -4,6 +4,8 @@ MIT license
 written by Adafruit Industries
 */
 #include "../dht/DHT.h"
+#include "../common/log.h"
+#include "../common/trace.h"
 
 DHT::DHT(uint8_t type) {
   _type = type;
@@ -17,7 +19,7 @@ void DHT::begin(void) {
   // Using this value makes sure that millis() - lastreadtime will be
   // >= MIN_INTERVAL right away. Note that this assignment wraps around,
   // but so will the subtraction.
-  debug_print("Max clock cycles: %ld", _maxcycles);
+  log_debug(SENSOR, "Max clock cycles: %ld", _maxcycles);
   _out(PC1, DHT_D_REG);
   _off(PC1, PORTC);
 }
@@ -110,6 +112,8 @@ double DHT::computeHeatIndex(double temperature, double percentHumidity, bool is
 }
 
 bool DHT::read() {
+  trace(TRACE_DHT_READ, 0);
+
   // Reset 40 bits of received data to zero.
   data[0] = data[1] = data[2] = data[3] = data[4] = 0;
 
@@ -142,11 +146,16 @@ bool DHT::read() {
     // First expect a low signal for ~80 microseconds followed by a high signal
     // for ~80 microseconds again.
     if (expectPulse(false) == 0) {
-    	debug_print("Timeout waiting for start signal low pulse.");
+    	// Timed section is over, the console and the radio need interrupts
+    	sei();
+    	trace(TRACE_DHT_DONE, 1);
+    	log_warn(SENSOR, "Timeout waiting for start signal low pulse.");
       return false;
     }
     if (expectPulse(true) == 0) {
-    	debug_print("Timeout waiting for start signal high pulse.");
+    	sei();
+    	trace(TRACE_DHT_DONE, 2);
+    	log_warn(SENSOR, "Timeout waiting for start signal high pulse.");
       return false;
     }
 
@@ -175,8 +184,8 @@ bool DHT::read() {
     uint32_t lowCycles  = cycles[2*i];
     uint32_t highCycles = cycles[2*i+1];
     if ((lowCycles == 0) || (highCycles == 0)) {
-        debug_print("i=%d", i);
-    	debug_print("Timeout waiting for pulse.");
+    	trace(TRACE_DHT_DONE, 3 | (i << 8));
+    	log_warn(SENSOR, "Timeout waiting for pulse %d.", i);
     	return false;
     }
     data[i/8] <<= 1;
@@ -190,20 +199,22 @@ bool DHT::read() {
     // stored data.
   }
 
-  /*debug_print("Received:");
-  debug_print("data[0]=%d", data[0]);
-  debug_print("data[1]=%d", data[1]);
-  debug_print("data[2]=%d", data[2]);
-  debug_print("data[3]=%d", data[3]);
-  debug_print("data[4]=%d", data[4]);
-  debug_print("checksum=%d", (data[0] + data[1] + data[2] + data[3]) & 0xFF);*/
+  /*log_debug(SENSOR, "Received:");
+  log_debug(SENSOR, "data[0]=%d", data[0]);
+  log_debug(SENSOR, "data[1]=%d", data[1]);
+  log_debug(SENSOR, "data[2]=%d", data[2]);
+  log_debug(SENSOR, "data[3]=%d", data[3]);
+  log_debug(SENSOR, "data[4]=%d", data[4]);
+  log_debug(SENSOR, "checksum=%d", (data[0] + data[1] + data[2] + data[3]) & 0xFF);*/
 
   // Check we read 40 bits and that the checksum matches.
   if (data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+    trace(TRACE_DHT_DONE, 0);
     return true;
   }
   else {
-	  debug_print("Checksum failure!");
+	  trace(TRACE_DHT_DONE, 4);
+	  log_warn(SENSOR, "Checksum failure!");
     return false;
   }
 }
@@ -0,0 +1,115 @@
+/********************************************************************************
+Includes
+********************************************************************************/
+#include "host_platform.h"
+#include "nrf24emu.h"
+
+/********************************************************************************
+	Global Variables
+********************************************************************************/
+NRF24Emulator nrf24emu;
+
+/* ======================================================= */
+// The pins go straight to nrf24emu, IRQ is delivered by its handler
+void setup_io()
+{
+} // setup_io
+
+/* ======================================================= */
+void setup_spi()
+{
+} // setup_spi
+
+/* ======================================================= */
+void setup_irq()
+{
+} // setup_irq
+
+/* ======================================================= */
+void setCSN(uint8_t value)
+{
+	nrf24emu.csn(value);
+}
+
+/* ======================================================= */
+void setCE(uint8_t value)
+{
+	nrf24emu.ce(value);
+}
+
+/* ======================================================= */
+uint8_t transfer_spi(uint8_t tx_)
+{
+	return nrf24emu.spi(tx_);
+} // transfer_spi
+
+/* ======================================================= */
+void transfer_spi_buffer(const uint8_t* tx, uint8_t* rx, uint8_t len)
+{
+	while (len--) {
+		uint8_t in = transfer_spi(tx ? *tx++ : 0xff);
+		if (rx) {
+			*rx++ = in;
+		}
+	}
+} // transfer_spi_buffer
+
+/* ======================================================= */
+void write_spi_buffer(const uint8_t* tx, uint8_t len)
+{
+	while (len--) {
+		transfer_spi(tx ? *tx++ : 0);
+	}
+} // write_spi_buffer
+
+/* ======================================================= */
+// Jobs complete before the push returns
+bool spi_queue_push(spi_job_t* job)
+{
+	setCSN(0);
+	job->status = transfer_spi(job->cmd);
+	transfer_spi_buffer(job->tx, job->rx, job->len);
+	write_spi_buffer(NULL, job->pad);
+	setCSN(1);
+	if (job->flags & SPI_JOB_CE_HIGH) {
+		setCE(1);
+	}
+	job->done = 1;
+	return true;
+} // spi_queue_push
+
+/* ======================================================= */
+bool spi_queue_idle()
+{
+	return true;
+} // spi_queue_idle
+
+/* ======================================================= */
+void spi_queue_wait()
+{
+} // spi_queue_wait
+
+/* ======================================================= */
+// Same 128us tick as Timer1 on the node
+uint16_t platform_ticks()
+{
+	return (uint16_t) (nrf24emu.now() / 128);
+} // platform_ticks
+
+/* ======================================================= */
+void platform_delay_us(uint16_t micros)
+{
+	nrf24emu.advance(micros);
+} // platform_delay_us
+
+/* ======================================================= */
+void platform_delay_ms(uint16_t milisec)
+{
+	nrf24emu.advance(milisec * 1000UL);
+} // platform_delay_ms
+
+/* ======================================================= */
+void platform_read_flash(void* dst, const void* src, uint8_t len)
+{
+	memcpy(dst, src, len);
+} // platform_read_flash
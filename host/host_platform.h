@@ -0,0 +1,50 @@
+#ifndef HOST_PLATFORM_H_
+#define HOST_PLATFORM_H_
+
+/********************************************************************************
+Includes
+********************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../nrf24l01/spi_job.h"
+
+/********************************************************************************
+Macros and Defines
+********************************************************************************/
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+/* The emulated radio behind the pins, see nrf24emu.h */
+class NRF24Emulator;
+extern NRF24Emulator nrf24emu;
+
+/* =========== SPI and GPIO function ============ */
+void setup_io();
+void setup_spi();
+void setup_irq();
+void setCSN(uint8_t value);
+void setCE(uint8_t value);
+uint8_t transfer_spi(uint8_t tx_);
+void transfer_spi_buffer(const uint8_t* tx, uint8_t* rx, uint8_t len);
+void write_spi_buffer(const uint8_t* tx, uint8_t len);
+
+/* =========== SPI queue, runs synchronously on the host ============ */
+bool spi_queue_push(spi_job_t* job);
+bool spi_queue_idle();
+void spi_queue_wait();
+
+#define PLATFORM_TICK_US 128
+
+uint16_t platform_ticks();
+void platform_delay_us(uint16_t micros);
+void platform_delay_ms(uint16_t milisec);
+
+/* =========== Program memory is plain memory on the host ============ */
+#define PLATFORM_FLASH
+
+void platform_read_flash(void* dst, const void* src, uint8_t len);
+
+#endif /* HOST_PLATFORM_H_ */
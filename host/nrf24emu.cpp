@@ -0,0 +1,643 @@
+/**
+ * @file nrf24emu.cpp
+ *
+ * Register level nRF24L01(+) emulator, see nrf24emu.h
+ *
+ * Timing and current figures follow the nRF24L01+ product specification:
+ * 130us TX/RX settling, ARD measured from the end of one transmission to
+ * the start of the next, 11.3mA TX at 0dBm, 12.6-13.5mA RX, 26uA
+ * Standby-I, 320uA Standby-II.
+ */
+
+#include <string.h>
+
+#include "host_platform.h"
+#include "nrf24emu.h"
+#include "../nrf24l01/nRF24L01.h"
+
+/****************************************************************************/
+
+NRF24Emulator::NRF24Emulator():
+  ack_payload_pending(false),
+  p_variant(true),
+  features_active(false),
+  loss(0),
+  pd2stby_us(1500),
+  spi_byte_us(2),
+  csn_level(1),
+  ce_level(0),
+  ce_high_at(0),
+  now_us(0),
+  powered_at(0),
+  por_until(0),
+  rng(1),
+  irq_level(false),
+  irq_handler(NULL),
+  cmd(NOP),
+  pos(0),
+  tx_busy(false),
+  tx_done_at(0),
+  tx_ok(false),
+  tx_arc(0),
+  peer_has_head(false)
+{
+  memset(noise,0,sizeof noise);
+  reset();
+  clearCounters();
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::reset(void)
+{
+  memset(regs,0,sizeof regs);
+  regs[CONFIG] = 0x08;
+  regs[EN_AA] = 0x3f;
+  regs[EN_RXADDR] = 0x03;
+  regs[SETUP_AW] = 0x03;
+  regs[SETUP_RETR] = 0x03;
+  regs[RF_CH] = 0x02;
+  regs[RF_SETUP] = p_variant ? 0x0e : 0x0f;
+  regs[RX_ADDR_P2] = 0xc3;
+  regs[RX_ADDR_P3] = 0xc4;
+  regs[RX_ADDR_P4] = 0xc5;
+  regs[RX_ADDR_P5] = 0xc6;
+  memset(addr_p0,0xe7,sizeof addr_p0);
+  memset(addr_p1,0xc2,sizeof addr_p1);
+  memset(addr_tx,0xe7,sizeof addr_tx);
+
+  tx_fifo.clear();
+  tx_noack.clear();
+  rx_fifo.clear();
+  rx_pipe.clear();
+  features_active = false;
+  tx_busy = false;
+  peer_has_head = false;
+  irq_level = false;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::powerOn(uint16_t por_us)
+{
+  reset();
+  por_until = now_us + por_us;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::clearCounters(void)
+{
+  memset(&counters,0,sizeof counters);
+  peer_log.clear();
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::setNoise(uint8_t channel, uint8_t percent)
+{
+  if ( channel < sizeof noise )
+    noise[channel] = percent;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::queueAckPayload(const uint8_t* buf, uint8_t len)
+{
+  ack_payload.assign(buf,buf + len);
+  ack_payload_pending = true;
+}
+
+/****************************************************************************/
+
+uint8_t NRF24Emulator::status(void) const
+{
+  uint8_t result = regs[STATUS] & ( _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) );
+
+  if ( rx_fifo.empty() )
+    result |= 0x07 << RX_P_NO;
+  else
+    result |= rx_pipe.front() << RX_P_NO;
+
+  if ( tx_fifo.size() >= 3 )
+    result |= _BV(TX_FULL);
+
+  return result;
+}
+
+/****************************************************************************/
+
+uint8_t NRF24Emulator::fifo_status(void) const
+{
+  uint8_t result = 0;
+
+  if ( tx_fifo.size() >= 3 )
+    result |= _BV(FIFO_FULL);
+  if ( tx_fifo.empty() )
+    result |= _BV(TX_EMPTY);
+  if ( rx_fifo.size() >= 3 )
+    result |= _BV(RX_FULL);
+  if ( rx_fifo.empty() )
+    result |= _BV(RX_EMPTY);
+
+  return result;
+}
+
+/****************************************************************************/
+
+uint8_t NRF24Emulator::address_width(void) const
+{
+  uint8_t aw = regs[SETUP_AW] & 0x03;
+  return aw ? aw + 2 : 5;
+}
+
+/****************************************************************************/
+
+bool NRF24Emulator::dynamic_pipe(uint8_t pipe) const
+{
+  return ( regs[FEATURE] & _BV(EN_DPL) ) && ( regs[DYNPD] & _BV(pipe) );
+}
+
+/****************************************************************************/
+
+uint32_t NRF24Emulator::airtime_us(uint8_t payload_len) const
+{
+  uint8_t setup = regs[RF_SETUP];
+  uint8_t crc = 0;
+  if ( ( regs[CONFIG] & _BV(EN_CRC) ) || regs[EN_AA] )
+    crc = ( regs[CONFIG] & _BV(CRCO) ) ? 2 : 1;
+
+  bool fast = !( setup & _BV(RF_DR_LOW) ) && ( setup & _BV(RF_DR_HIGH) );
+  uint32_t bits = 8 * ( ( fast ? 2 : 1 ) + address_width() + payload_len + crc ) + 9;
+
+  if ( setup & _BV(RF_DR_LOW) )
+    return bits * 4;
+  if ( fast )
+    return ( bits + 1 ) / 2;
+  return bits;
+}
+
+/****************************************************************************/
+
+uint16_t NRF24Emulator::tx_current_uA(void) const
+{
+  static const uint16_t pa_current[] = { 7000, 7500, 9000, 11300 };
+  return pa_current[ ( regs[RF_SETUP] >> RF_PWR_LOW ) & 0x03 ];
+}
+
+/****************************************************************************/
+
+uint16_t NRF24Emulator::rx_current_uA(void) const
+{
+  if ( regs[RF_SETUP] & _BV(RF_DR_LOW) )
+    return 12600;
+  if ( regs[RF_SETUP] & _BV(RF_DR_HIGH) )
+    return 13500;
+  return 13100;
+}
+
+/****************************************************************************/
+
+uint8_t NRF24Emulator::random_percent(void)
+{
+  rng = rng * 1103515245UL + 12345UL;
+  return ( rng >> 16 ) % 100;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::csn(uint8_t level)
+{
+  if ( level == csn_level )
+    return;
+
+  counters.csn_edges++;
+  csn_level = level;
+
+  if ( !level )
+  {
+    counters.transactions++;
+    pos = 0;
+    shift_in.clear();
+  }
+  else if ( pos )
+  {
+    end_transaction();
+  }
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::ce(uint8_t level)
+{
+  if ( level == ce_level )
+    return;
+
+  counters.ce_edges++;
+  ce_level = level;
+
+  if ( level )
+  {
+    ce_high_at = now_us;
+    try_start_tx();
+  }
+  else if ( tx_busy && now_us - ce_high_at < 10 )
+  {
+    // A CE pulse shorter than 10us does not start a transmission
+    tx_busy = false;
+  }
+}
+
+/****************************************************************************/
+
+bool NRF24Emulator::irq(void) const
+{
+  return irq_level;
+}
+
+/****************************************************************************/
+
+uint8_t NRF24Emulator::spi(uint8_t mosi)
+{
+  counters.spi_bytes++;
+  advance(spi_byte_us);
+
+  // MISO is tri-stated while CSN is high
+  if ( csn_level )
+    return 0xff;
+
+  uint8_t miso;
+  if ( pos == 0 )
+  {
+    cmd = mosi;
+    miso = status();
+  }
+  else
+  {
+    miso = read_byte(pos - 1);
+    shift_in.push_back(mosi);
+  }
+
+  if ( pos < 0xff )
+    pos++;
+
+  return miso;
+}
+
+/****************************************************************************/
+
+uint8_t NRF24Emulator::read_byte(uint8_t index)
+{
+  if ( ( cmd & 0xe0 ) == R_REGISTER )
+  {
+    uint8_t reg = cmd & REGISTER_MASK;
+    switch ( reg )
+    {
+      case RX_ADDR_P0:
+        return index < 5 ? addr_p0[index] : 0;
+      case RX_ADDR_P1:
+        return index < 5 ? addr_p1[index] : 0;
+      case TX_ADDR:
+        return index < 5 ? addr_tx[index] : 0;
+      case STATUS:
+        return status();
+      case FIFO_STATUS:
+        return fifo_status();
+      case CD:
+        return ( random_percent() < noise[ regs[RF_CH] & 0x7f ] ) ? 1 : 0;
+      case DYNPD:
+      case FEATURE:
+        if ( !p_variant && !features_active )
+          return 0;
+        return regs[reg];
+      default:
+        return index ? 0 : regs[reg];
+    }
+  }
+
+  if ( cmd == R_RX_PAYLOAD )
+  {
+    if ( rx_fifo.empty() || index >= rx_fifo.front().size() )
+      return 0;
+    return rx_fifo.front()[index];
+  }
+
+  if ( cmd == R_RX_PL_WID )
+    return rx_fifo.empty() ? 0 : rx_fifo.front().size();
+
+  return 0;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::end_transaction(void)
+{
+  if ( ( cmd & 0xe0 ) == W_REGISTER )
+  {
+    write_register(cmd & REGISTER_MASK,shift_in);
+  }
+  else if ( cmd == W_TX_PAYLOAD || cmd == W_TX_PAYLOAD_NO_ACK )
+  {
+    bool noack = ( cmd == W_TX_PAYLOAD_NO_ACK );
+
+    // Without EN_DYN_ACK the NO_ACK command does not exist
+    if ( noack && !( regs[FEATURE] & _BV(EN_DYN_ACK) ) )
+      return;
+
+    if ( tx_fifo.size() < 3 && !shift_in.empty() )
+    {
+      if ( shift_in.size() > 32 )
+        shift_in.resize(32);
+      tx_fifo.push_back(shift_in);
+      tx_noack.push_back(noack);
+    }
+  }
+  else if ( cmd == R_RX_PAYLOAD )
+  {
+    if ( !rx_fifo.empty() && !shift_in.empty() )
+    {
+      rx_fifo.erase(rx_fifo.begin());
+      rx_pipe.erase(rx_pipe.begin());
+    }
+  }
+  else if ( cmd == FLUSH_TX )
+  {
+    tx_fifo.clear();
+    tx_noack.clear();
+    tx_busy = false;
+    peer_has_head = false;
+  }
+  else if ( cmd == FLUSH_RX )
+  {
+    rx_fifo.clear();
+    rx_pipe.clear();
+  }
+  else if ( cmd == ACTIVATE )
+  {
+    if ( !p_variant && !shift_in.empty() && shift_in[0] == 0x73 )
+      features_active = !features_active;
+  }
+
+  try_start_tx();
+  update_irq();
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::write_register(uint8_t reg, const Payload& data)
+{
+  if ( data.empty() || now_us < por_until )
+    return;
+
+  uint8_t value = data[0];
+
+  switch ( reg )
+  {
+    case RX_ADDR_P0:
+      memcpy(addr_p0,&data[0],data.size() < 5 ? data.size() : 5);
+      break;
+    case RX_ADDR_P1:
+      memcpy(addr_p1,&data[0],data.size() < 5 ? data.size() : 5);
+      break;
+    case TX_ADDR:
+      memcpy(addr_tx,&data[0],data.size() < 5 ? data.size() : 5);
+      break;
+    case STATUS:
+      regs[STATUS] &= ~( value & ( _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) ) );
+      break;
+    case OBSERVE_TX:
+    case CD:
+    case FIFO_STATUS:
+      break;
+    case FEATURE:
+    case DYNPD:
+      if ( p_variant || features_active )
+        regs[reg] = value;
+      break;
+    case RF_SETUP:
+      // RF_DR_LOW is reserved on the original nRF24L01
+      regs[reg] = p_variant ? value : ( value & ~_BV(RF_DR_LOW) );
+      break;
+    case RF_CH:
+      regs[reg] = value & 0x7f;
+      regs[OBSERVE_TX] &= 0x0f;
+      break;
+    case CONFIG:
+      if ( ( value & _BV(PWR_UP) ) && !powered() )
+        powered_at = now_us;
+      if ( !( value & _BV(PWR_UP) ) )
+        tx_busy = false;
+      regs[reg] = value;
+      break;
+    default:
+      if ( reg < sizeof regs )
+        regs[reg] = value;
+      break;
+  }
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::accrue(uint64_t until)
+{
+  if ( until <= now_us )
+    return;
+
+  uint64_t dt = until - now_us;
+  now_us = until;
+
+  if ( !powered() )
+  {
+    counters.charge_uC += dt * 0.9 / 1e6;
+    return;
+  }
+
+  counters.radio_on_us += dt;
+
+  // The charge of a transmission is booked when it starts
+  if ( tx_busy )
+    return;
+
+  uint32_t current = 26;
+  if ( ce_level )
+    current = prim_rx() ? rx_current_uA() : 320;
+
+  counters.charge_uC += dt * current / 1e6;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::advance(uint32_t us)
+{
+  uint64_t target = now_us + us;
+
+  while ( tx_busy && tx_done_at <= target )
+  {
+    accrue(tx_done_at);
+    finish_tx();
+  }
+
+  accrue(target);
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::try_start_tx(void)
+{
+  if ( tx_busy || !ce_level || !powered() || prim_rx() || tx_fifo.empty() )
+    return;
+
+  // Communication is halted while MAX_RT is asserted
+  if ( regs[STATUS] & _BV(MAX_RT) )
+    return;
+
+  uint64_t start = now_us;
+  if ( start < powered_at + pd2stby_us )
+  {
+    counters.early_tx++;
+    start = powered_at + pd2stby_us;
+  }
+
+  const Payload& payload = tx_fifo.front();
+  bool noack = tx_noack.front() || !( regs[EN_AA] & _BV(ENAA_P0) );
+  uint8_t arc = regs[SETUP_RETR] & 0x0f;
+  uint32_t air = airtime_us(payload.size());
+  uint32_t ack_air = airtime_us(ack_payload_pending ? ack_payload.size() : 0);
+  uint32_t ard = ard_us();
+  uint32_t rx_window = ( regs[RF_SETUP] & _BV(RF_DR_LOW) ) ? 500 : 250;
+  double charge_pC = 0;
+
+  // PLL settling before the first transmission
+  uint64_t t = start + 130;
+  charge_pC += 130.0 * 8000;
+
+  tx_ok = false;
+  tx_arc = 0;
+
+  for ( uint8_t attempt = 0; attempt <= arc; attempt++ )
+  {
+    counters.tx_attempts++;
+    t += air;
+    charge_pC += (double) air * tx_current_uA();
+
+    bool lost = random_percent() < loss;
+    if ( !lost && !peer_has_head )
+    {
+      peer_log.push_back(payload);
+      peer_has_head = true;
+    }
+
+    if ( noack )
+    {
+      tx_ok = true;
+      break;
+    }
+
+    if ( !lost && random_percent() >= loss )
+    {
+      // Turnaround and the ack itself
+      t += 130 + ack_air;
+      charge_pC += ( 130.0 + ack_air ) * rx_current_uA();
+      tx_ok = true;
+      break;
+    }
+
+    // Listen for the ack that never comes, then idle until ARD expires
+    charge_pC += (double) rx_window * rx_current_uA();
+    if ( attempt < arc )
+    {
+      t += ard;
+      tx_arc++;
+    }
+    else
+    {
+      t += rx_window;
+    }
+  }
+
+  counters.charge_uC += charge_pC / 1e6;
+  tx_done_at = t;
+  tx_busy = true;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::finish_tx(void)
+{
+  tx_busy = false;
+  regs[OBSERVE_TX] = ( regs[OBSERVE_TX] & 0xf0 ) | tx_arc;
+
+  if ( tx_ok )
+  {
+    bool noack = tx_noack.front();
+    tx_fifo.erase(tx_fifo.begin());
+    tx_noack.erase(tx_noack.begin());
+    peer_has_head = false;
+    regs[STATUS] |= _BV(TX_DS);
+    counters.tx_packets++;
+
+    if ( ack_payload_pending && !noack && rx_fifo.size() < 3 )
+    {
+      rx_fifo.push_back(ack_payload);
+      rx_pipe.push_back(0);
+      regs[STATUS] |= _BV(RX_DR);
+      ack_payload_pending = false;
+    }
+  }
+  else
+  {
+    regs[STATUS] |= _BV(MAX_RT);
+    if ( ( regs[OBSERVE_TX] >> PLOS_CNT ) < 0x0f )
+      regs[OBSERVE_TX] += 1 << PLOS_CNT;
+    counters.tx_failed++;
+  }
+
+  update_irq();
+
+  // With CE held high the next payload follows right away
+  try_start_tx();
+}
+
+/****************************************************************************/
+
+bool NRF24Emulator::deliver(uint8_t pipe, const uint8_t* buf, uint8_t len)
+{
+  if ( !powered() || !prim_rx() || !ce_level || pipe > 5 )
+    return false;
+  if ( !( regs[EN_RXADDR] & _BV(pipe) ) || rx_fifo.size() >= 3 )
+    return false;
+
+  Payload payload(buf,buf + len);
+  if ( !dynamic_pipe(pipe) )
+  {
+    uint8_t width = regs[RX_PW_P0 + pipe];
+    if ( !width )
+      return false;
+    payload.resize(width,0);
+  }
+
+  rx_fifo.push_back(payload);
+  rx_pipe.push_back(pipe);
+  regs[STATUS] |= _BV(RX_DR);
+  update_irq();
+
+  return true;
+}
+
+/****************************************************************************/
+
+void NRF24Emulator::update_irq(void)
+{
+  // CONFIG holds the MASK_* bits at the same positions as the STATUS flags
+  uint8_t flags = regs[STATUS] & ~regs[CONFIG] & ( _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) );
+  bool level = flags != 0;
+
+  if ( level && !irq_level && irq_handler )
+  {
+    irq_level = level;
+    irq_handler();
+  }
+  irq_level = level;
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
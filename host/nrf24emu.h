@@ -0,0 +1,176 @@
+/**
+ * @file nrf24emu.h
+ *
+ * Register level nRF24L01(+) emulator for host builds of the RF24 driver.
+ *
+ * It decodes the SPI command set from nRF24L01.h, keeps the register file,
+ * the three deep TX/RX FIFOs and STATUS, and runs Enhanced ShockBurst
+ * against a virtual peer with configurable loss.  Time is virtual: it only
+ * advances with SPI traffic and platform delays, so every run is exact and
+ * repeatable.
+ */
+
+#ifndef NRF24EMU_H_
+#define NRF24EMU_H_
+
+#include <stdint.h>
+#include <vector>
+
+class NRF24Emulator
+{
+public:
+  /**
+   * Bus and energy counters, cleared by clearCounters()
+   */
+  struct Counters
+  {
+    uint32_t spi_bytes;     /**< Bytes clocked over SPI */
+    uint32_t transactions;  /**< CSN framed transactions */
+    uint32_t csn_edges;     /**< CSN level changes */
+    uint32_t ce_edges;      /**< CE level changes */
+    uint32_t tx_packets;    /**< Payloads that left the TX FIFO acknowledged */
+    uint32_t tx_failed;     /**< MAX_RT events */
+    uint32_t tx_attempts;   /**< Transmissions on air, retries included */
+    uint32_t early_tx;      /**< TX requested before the oscillator settled */
+    uint32_t radio_on_us;   /**< Time spent out of Power Down */
+    double charge_uC;       /**< Charge drawn by the radio */
+  };
+
+  Counters counters;
+
+  NRF24Emulator();
+
+  /** Power on reset: register defaults, empty FIFOs, Power Down */
+  void reset(void);
+
+  /**
+   * Supply comes up: reset(), and register writes do not stick for the
+   * first @p por_us
+   */
+  void powerOn(uint16_t por_us = 4500);
+
+  /* ---- Pins, called by host_platform.cpp ---- */
+  void csn(uint8_t level);
+  void ce(uint8_t level);
+  uint8_t spi(uint8_t mosi);
+  bool irq(void) const;
+
+  /**
+   * Let virtual time pass, running any transmission that completes
+   *
+   * @param us Microseconds to advance
+   */
+  void advance(uint32_t us);
+
+  /** @return Virtual time in microseconds since construction */
+  uint64_t now(void) const { return now_us; }
+
+  /**
+   * Called on every falling edge of IRQ, like INT0 on the node
+   */
+  void setIrqHandler(void (*handler)(void)) { irq_handler = handler; }
+
+  /* ---- Air model ---- */
+
+  /** Chance in percent that a packet, or its ack, is lost */
+  void setLoss(uint8_t percent) { loss = percent; }
+
+  /** Restart the loss and noise draws, for runs that compare settings */
+  void setSeed(uint32_t seed) { rng = seed; }
+
+  /** False emulates the original nRF24L01 (no 250KBPS, ACTIVATE needed) */
+  void setVariant(bool plus) { p_variant = plus; }
+
+  /** Chance in percent that RPD/CD reads 1 on a channel */
+  void setNoise(uint8_t channel, uint8_t percent);
+
+  /** Time from PWR_UP to Standby-I, 1500us with the crystal of common modules */
+  void setPowerUpDelay(uint16_t us) { pd2stby_us = us; }
+
+  /** SPI byte time in microseconds, 2us at fck/2 on an 8 MHz AVR */
+  void setSpiByteTime(uint8_t us) { spi_byte_us = us; }
+
+  /** Payload the peer returns with its next ack */
+  void queueAckPayload(const uint8_t* buf, uint8_t len);
+
+  /**
+   * A packet from the peer arrives on @p pipe while listening
+   *
+   * @return True if the radio accepted it into the RX FIFO
+   */
+  bool deliver(uint8_t pipe, const uint8_t* buf, uint8_t len);
+
+  /** Payloads the peer received, duplicates suppressed like ESB does */
+  std::vector< std::vector<uint8_t> > peer_log;
+
+  void clearCounters(void);
+
+  /** Register value as the chip holds it, for checks and reports */
+  uint8_t peek(uint8_t reg) const { return regs[reg & 0x1f]; }
+
+private:
+  typedef std::vector<uint8_t> Payload;
+
+  uint8_t regs[0x20];
+  uint8_t addr_p0[5];
+  uint8_t addr_p1[5];
+  uint8_t addr_tx[5];
+
+  std::vector<Payload> tx_fifo;
+  std::vector<bool> tx_noack;
+  std::vector<Payload> rx_fifo;
+  std::vector<uint8_t> rx_pipe;
+  Payload ack_payload;
+  bool ack_payload_pending;
+
+  bool p_variant;
+  bool features_active;
+  uint8_t loss;
+  uint8_t noise[128];
+  uint16_t pd2stby_us;
+  uint8_t spi_byte_us;
+
+  uint8_t csn_level;
+  uint8_t ce_level;
+  uint64_t ce_high_at;
+  uint64_t now_us;
+  uint64_t powered_at;
+  uint64_t por_until;
+  uint32_t rng;
+  bool irq_level;
+  void (*irq_handler)(void);
+
+  // SPI transaction in progress
+  uint8_t cmd;
+  uint8_t pos;
+  Payload shift_in;
+
+  // Transmission in progress
+  bool tx_busy;
+  uint64_t tx_done_at;
+  bool tx_ok;
+  uint8_t tx_arc;
+  bool peer_has_head;
+
+  uint8_t status(void) const;
+  uint8_t fifo_status(void) const;
+  uint8_t address_width(void) const;
+  bool powered(void) const { return regs[0x00] & 0x02; }
+  bool prim_rx(void) const { return regs[0x00] & 0x01; }
+  bool dynamic_pipe(uint8_t pipe) const;
+  uint32_t airtime_us(uint8_t payload_len) const;
+  uint32_t ard_us(void) const { return 250UL * ( ( regs[0x04] >> 4 ) + 1 ); }
+  uint16_t tx_current_uA(void) const;
+  uint16_t rx_current_uA(void) const;
+  uint8_t random_percent(void);
+
+  uint8_t read_byte(uint8_t index);
+  void end_transaction(void);
+  void write_register(uint8_t reg, const Payload& data);
+  void accrue(uint64_t until);
+  void try_start_tx(void);
+  void finish_tx(void);
+  void update_irq(void);
+};
+
+#endif /* NRF24EMU_H_ */
@@ -0,0 +1,529 @@
+/**
+ * @file rf24bench.cpp
+ *
+ * Per-API cost of the RF24 driver measured against the emulated radio.
+ *
+ * Every figure comes from nrf24emu: SPI bytes, CSN framed transactions,
+ * CE edges, virtual time and the charge drawn by the radio.
+ */
+
+#include <stdio.h>
+
+#include <string.h>
+#include <vector>
+
+#include "../nrf24l01/RF24.h"
+#include "../nrf24l01/RF24Config.h"
+#include "../nrf24l01/RF24Link.h"
+#include "../nrf24l01/RF24LinkStats.h"
+#include "../boot/ota.h"
+#include "nrf24emu.h"
+
+RF24 radio;
+const uint64_t pipes[2] = { 0xF0F0F0F0E1LL, 0xF0F0F0F0D2LL };
+
+// configure() below as a compile time configuration
+constexpr rf24_config_t bench_config = { RF24_250KBPS, RF24_CRC_16, RF24_PA_MAX,
+  110, 5, 4000, 15, 32, true, 0, 0xF0F0F0F0E1LL, 0xF0F0F0F0D2LL };
+RF24_CHECK_CONFIG(bench_config);
+const rf24_image_t bench_image PLATFORM_FLASH = rf24_config_image(bench_config);
+
+// The same on an nRF24L01 without the plus, where begin() ends up at 1MBPS
+constexpr rf24_config_t bench_config_1m = { RF24_1MBPS, RF24_CRC_16, RF24_PA_MAX,
+  110, 5, 4000, 15, 32, true, 0, 0xF0F0F0F0E1LL, 0xF0F0F0F0D2LL };
+RF24_CHECK_CONFIG(bench_config_1m);
+
+/****************************************************************************/
+
+static void on_irq(void)
+{
+  radio.irq();
+}
+
+/****************************************************************************/
+
+struct Probe
+{
+  NRF24Emulator::Counters start;
+  uint64_t start_us;
+
+  Probe() { begin(); }
+
+  void begin(void)
+  {
+    start = nrf24emu.counters;
+    start_us = nrf24emu.now();
+  }
+
+  void report(const char* name)
+  {
+    const NRF24Emulator::Counters& now = nrf24emu.counters;
+    printf("%-28s %6u %6u %4u %9llu %9.2f %4u/%-4u\n",
+           name,
+           (unsigned) ( now.spi_bytes - start.spi_bytes ),
+           (unsigned) ( now.transactions - start.transactions ),
+           (unsigned) ( now.ce_edges - start.ce_edges ),
+           (unsigned long long) ( nrf24emu.now() - start_us ),
+           now.charge_uC - start.charge_uC,
+           (unsigned) ( now.tx_packets - start.tx_packets ),
+           (unsigned) ( now.tx_attempts - start.tx_attempts ));
+    begin();
+  }
+};
+
+/****************************************************************************/
+
+static void configure(void)
+{
+  radio.begin();
+  radio.setRetries(15,15);
+  radio.enableDynamicPayloads();
+  radio.setPALevel(RF24_PA_MAX);
+  radio.setChannel(110);
+  radio.openWritingPipe(pipes[0]);
+  radio.openReadingPipe(1,pipes[1]);
+}
+
+/****************************************************************************/
+
+static bool same_image(const rf24_image_t& a, const rf24_image_t& b)
+{
+  return !memcmp(a.shadow,b.shadow,sizeof a.shadow)
+    && !memcmp(a.rx_addr_p0,b.rx_addr_p0,sizeof a.rx_addr_p0)
+    && !memcmp(a.rx_addr_p1,b.rx_addr_p1,sizeof a.rx_addr_p1)
+    && !memcmp(a.rx_addr_lsb,b.rx_addr_lsb,sizeof a.rx_addr_lsb)
+    && !memcmp(a.tx_addr,b.tx_addr,sizeof a.tx_addr)
+    && !memcmp(a.rx_pw,b.rx_pw,sizeof a.rx_pw)
+    && a.payload_size == b.payload_size && a.flags == b.flags
+    && a.pipe0_reading_address == b.pipe0_reading_address;
+}
+
+/****************************************************************************/
+
+// configure() on a non-P chip must give the image built for one, and not
+// the nRF24L01+ image, which would clear LNA_HCURR
+static bool variant_run(void)
+{
+  constexpr rf24_image_t plus = rf24_config_image(bench_config_1m,true);
+  constexpr rf24_image_t non_p = rf24_config_image(bench_config_1m,false);
+  rf24_image_t image;
+
+  nrf24emu.setVariant(false);
+  nrf24emu.powerOn(0);
+  configure();
+  radio.getImage(&image,0);
+  nrf24emu.setVariant(true);
+  nrf24emu.powerOn(0);
+  configure();
+
+  bool ok = same_image(image,non_p) && ! same_image(image,plus);
+  printf("non-P constexpr image %s configure()\n",ok ? "matches" : "DIFFERS from");
+
+  return ok;
+}
+
+/****************************************************************************/
+
+// Loss in percent per PA level (-18, -12, -6, 0dBm) at three distances
+static const uint8_t loss_near[] = { 1, 0, 0, 0 };
+static const uint8_t loss_rooms[] = { 60, 25, 5, 0 };
+static const uint8_t loss_far[] = { 100, 90, 40, 10 };
+
+static void link_run(const char* name, const uint8_t* loss_at_pa, RF24Link* link)
+{
+  const uint16_t sends = 2000;
+  uint8_t data[19] = {100, 1, 4};
+  uint16_t delivered = 0;
+
+  configure();
+  radio.enableDynamicPayloads();
+  if ( link )
+    link->begin();
+  radio.powerUp();
+  nrf24emu.clearCounters();
+  nrf24emu.setSeed(1);
+
+  for ( uint16_t i = 0; i < sends; i++ )
+  {
+    nrf24emu.setLoss(loss_at_pa[( nrf24emu.peek(RF_SETUP) >> RF_PWR_LOW ) & 0x03]);
+    bool ok = radio.write(data,sizeof data);
+    delivered += ok;
+    if ( link )
+      link->update(ok);
+  }
+  nrf24emu.setLoss(0);
+
+  printf("%-28s %4u/%-4u %6u %9.2f\n",name,delivered,sends,
+         (unsigned) nrf24emu.counters.tx_attempts,
+         delivered ? nrf24emu.counters.charge_uC / delivered : 0.0);
+}
+
+/****************************************************************************/
+
+// Nothing gets through: step_up() has to move the retry delay up to its
+// longest and keep it there, in RF24Link and in SETUP_RETR alike.  The
+// shortest ARD for an 8 byte ack at 250KBPS is not of the form 2^k-1.
+static bool ard_run(void)
+{
+  RF24Link link(radio);
+  uint8_t data[19] = {100, 1, 4};
+  uint8_t last = 0;
+  bool ok = true;
+
+  configure();
+  radio.setDataRate(RF24_250KBPS);
+  link.begin(8);
+  radio.powerUp();
+  nrf24emu.setLoss(100);
+
+  printf("ARD under loss:");
+  for ( uint8_t i = 0; i < 12; i++ )
+  {
+    link.update(radio.write(data,sizeof data));
+    uint8_t ard = nrf24emu.peek(SETUP_RETR) >> ARD;
+    printf(" %u",ard);
+    if ( ard < last || ard != link.getRetryDelay() )
+      ok = false;
+    last = ard;
+  }
+  nrf24emu.setLoss(0);
+  printf(", %s\n",ok && last == 15 ? "never down" : "WENT DOWN");
+
+  return ok && last == 15;
+}
+
+/****************************************************************************/
+
+// A burst whose first payload brings an ack payload: every payload must
+// still end in an IRQ edge, or the node sleeps through to its timeout
+static bool burst_irq_run(void)
+{
+  const uint8_t setting[] = {1, 1, 0x84, 0x03};
+  uint8_t data1[] = {100, 1, 1, 0, 215};
+  uint8_t data2[] = {100, 1, 2, 1, 200};
+  const void* bufs[] = {data1, data2};
+  const uint8_t lens[] = {sizeof(data1), sizeof(data2)};
+  uint8_t irqs = 0;
+  bool done = false;
+
+  configure();
+  radio.enableAckPayload();
+  radio.powerUp();
+  nrf24emu.queueAckPayload(setting,sizeof setting);
+
+  radio.startBurst(bufs,lens,2);
+  for ( uint16_t polls = 2 * ( radio.getMaxTimeout() / 25 + 100 ); polls && ! done; polls-- )
+  {
+    platform_delay_us(50);
+    if ( ! radio.isTxPending() )
+    {
+      irqs++;
+      done = radio.serviceBurst();
+    }
+  }
+  uint8_t delivered = radio.finishBurst();
+
+  bool ok = done && delivered == 3 && radio.isAckPayloadAvailable();
+  printf("burst with ack payload: %u IRQs, delivered %x, %s\n",irqs,delivered,
+         ok ? "ok" : "IRQ STUCK");
+
+  return ok;
+}
+
+/****************************************************************************/
+
+// One reading per send, no-ack copies against ESB with the node's 750us ARD
+// and 15 retries.  Losses are drawn independently per packet, so the gap
+// between copies buys nothing here; it is for bursts of interference.
+static void copies_run(uint8_t loss, uint8_t copies)
+{
+  const uint16_t sends = 1000;
+  const uint16_t gap_us = 2000;
+  uint8_t data[19] = {100, 1, 6};
+  uint64_t longest = 0;
+  uint64_t total = 0;
+
+  configure();
+  radio.setRetries(2,15);
+  radio.powerUp();
+  nrf24emu.advance(5000);
+  nrf24emu.clearCounters();
+  nrf24emu.setSeed(1);
+  nrf24emu.setLoss(loss);
+
+  for ( uint16_t i = 0; i < sends; i++ )
+  {
+    data[3] = i;
+    data[4] = i >> 8;
+    uint64_t start = nrf24emu.now();
+    if ( copies )
+      radio.writeCopies(data,sizeof data,copies,gap_us);
+    else
+      radio.write(data,sizeof data);
+    uint64_t took = nrf24emu.now() - start;
+    total += took;
+    if ( took > longest )
+      longest = took;
+  }
+  nrf24emu.setLoss(0);
+
+  // The gateway keeps the first copy of each sequence number
+  std::vector<bool> seen(sends);
+  uint16_t delivered = 0;
+  for ( size_t i = 0; i < nrf24emu.peer_log.size(); i++ )
+  {
+    uint16_t seq = nrf24emu.peer_log[i][3] | ( nrf24emu.peer_log[i][4] << 8 );
+    if ( ! seen[seq] )
+      delivered++;
+    seen[seq] = true;
+  }
+
+  char name[28];
+  if ( copies )
+    snprintf(name,sizeof name,"%u no-ack cop%s, %u%% loss",copies,copies > 1 ? "ies" : "y",loss);
+  else
+    snprintf(name,sizeof name,"ESB 15 retries, %u%% loss",loss);
+  printf("%-28s %4u/%-4u %6u %9.2f %7llu %7llu\n",name,delivered,sends,
+         (unsigned) nrf24emu.counters.tx_attempts,
+         delivered ? nrf24emu.counters.charge_uC / delivered : 0.0,
+         (unsigned long long) ( total / sends ),(unsigned long long) longest);
+}
+
+/****************************************************************************/
+
+// A node that was fine for a while, then loses its line of sight
+static void stats_run(void)
+{
+  const uint8_t phases[] = { 0, 10, 40 };
+  uint8_t data[19] = {100, 1, 4};
+  RF24LinkStats stats(radio);
+  uint8_t summary[RF24_LINK_STATS_SUMMARY];
+
+  configure();
+  radio.setRetries(2,15);
+  radio.powerUp();
+  nrf24emu.setSeed(1);
+
+  for ( uint8_t p = 0; p < sizeof phases; p++ )
+  {
+    int16_t noticed = -1;
+    nrf24emu.setLoss(phases[p]);
+    for ( uint16_t i = 0; i < 200; i++ )
+    {
+      stats.update(radio.write(data,sizeof data));
+      if ( noticed < 0 && stats.isDegrading() )
+        noticed = i + 1;
+    }
+    stats.getSummary(summary);
+    stats.clearPeriod();
+
+    printf("%3u%% loss  %3u %3u ",phases[p],summary[0],summary[1]);
+    for ( uint8_t i = 2; i < 8; i++ )
+      printf(" %2u %2u",summary[i] & 0x0f,summary[i] >> 4);
+    printf("  %3u %u",summary[10],summary[11] & 0x0f);
+    if ( noticed > 0 )
+      printf("  degrading after %d sends",noticed);
+    printf("\n");
+  }
+  nrf24emu.setLoss(0);
+}
+
+/****************************************************************************/
+
+// The gateway's side of a firmware update: a 28KB image at 2MBPS, the
+// link time of each page from the emulator, the flash time OTA_PAGE_US.
+// Receiving the next page while the last one is written costs a page the
+// longer of the two instead of their sum.
+static void ota_run(uint8_t loss)
+{
+  const uint16_t pages = 224;
+  uint8_t header[2] = {OTA_PAGE, 0};
+  uint8_t data[32] = {0};
+  uint64_t link = 0, serial = 0, pipelined = 0;
+  uint16_t resent = 0;
+
+  configure();
+  radio.setDataRate(RF24_2MBPS);
+  radio.setRetries(rf24_ard_code(OTA_GATEWAY_ARD_US),15);
+  radio.powerUp();
+  nrf24emu.advance(5000);
+  nrf24emu.clearCounters();
+  nrf24emu.setSeed(1);
+  nrf24emu.setLoss(loss);
+
+  for ( uint16_t page = 0; page < pages; page++ )
+  {
+    uint64_t start = nrf24emu.now();
+    bool ok;
+    header[1] = page;
+    do
+    {
+      ok = radio.write(header,sizeof header);
+      for ( uint8_t i = 0; ok && i < OTA_PAGE_PAYLOADS; i++ )
+        ok = radio.write(data,sizeof data);
+      resent += ! ok;
+    }
+    while ( ! ok );
+
+    uint64_t took = nrf24emu.now() - start;
+    link += took;
+    serial += took + OTA_PAGE_US;
+    pipelined += took > OTA_PAGE_US ? took : OTA_PAGE_US;
+  }
+  nrf24emu.setLoss(0);
+
+  const double bytes = pages * OTA_PAGE_SIZE;
+  printf("%3u%% loss %8.2f %8.1f %8.1f %8.1f %6u\n",loss,link / 1000.0 / pages,
+         bytes * 1000 / link,bytes * 1000 / serial,bytes * 1000 / pipelined,resent);
+}
+
+/****************************************************************************/
+
+int main(void)
+{
+  nrf24emu.setIrqHandler(on_irq);
+
+  printf("%-28s %6s %6s %4s %9s %9s %9s\n",
+         "api", "spi_b", "trans", "ce", "time_us", "charge_uC", "ok/tries");
+
+  Probe probe;
+
+  radio.begin();
+  probe.report("begin()");
+
+  configure();
+  probe.report("begin() + node config");
+
+  // Bring-up from the cached image, after an MCU reset the radio kept its
+  // supply through, and after a brown-out that put it in power on reset
+  rf24_image_t image;
+  radio.getImage(&image,1);
+  RF24 node;
+  probe.begin();
+  bool warm = node.beginFromImage(&image,1);
+  probe.report("beginFromImage(), warm");
+
+  nrf24emu.powerOn();
+  probe.begin();
+  configure();
+  probe.report("begin() + node config, cold");
+
+  nrf24emu.powerOn();
+  probe.begin();
+  bool cold = node.beginFromImage(&image,1);
+  probe.report("beginFromImage(), cold");
+
+  bool flash = node.beginFromFlash(&bench_image);
+  probe.report("beginFromFlash(), warm");
+
+  uint8_t data1[] = {100, 1, 1, 0, 215};
+  uint8_t data2[] = {100, 1, 2, 1, 200};
+
+  radio.powerUp();
+  probe.report("powerUp()");
+
+  radio.write(data1,sizeof data1);
+  probe.report("write() 5B, 0% loss");
+
+  // Gateway setting the send period to 2 hours in the ack
+  const uint8_t setting[] = {1, 1, 0x84, 0x03};
+  uint8_t downlink[32];
+  radio.enableAckPayload();
+  probe.begin();
+  nrf24emu.queueAckPayload(setting,sizeof setting);
+  bool sent = radio.write(data1,sizeof data1);
+  bool got = sent && radio.isAckPayloadAvailable();
+  uint8_t downlink_len = got ? radio.getDynamicPayloadSize() : 0;
+  if ( got )
+    radio.read(downlink,downlink_len);
+  probe.report("write() 5B + 4B ack payload");
+
+  nrf24emu.setLoss(30);
+  for ( uint8_t i = 0; i < 10; i++ )
+    radio.write(data1,sizeof data1);
+  probe.report("10x write() 5B, 30% loss");
+  nrf24emu.setLoss(0);
+
+  const void* bufs[] = {data1, data2};
+  const uint8_t lens[] = {sizeof(data1), sizeof(data2)};
+  radio.writeBurst(bufs,lens,2);
+  probe.report("writeBurst() 2x5B");
+
+  const uint8_t channels[] = { 110, 100, 105, 115, 120, 125 };
+  uint8_t busy[sizeof channels];
+  nrf24emu.setNoise(110,30);
+  nrf24emu.setNoise(100,50);
+  nrf24emu.setNoise(115,5);
+  probe.begin();
+  uint8_t best = radio.surveyChannels(channels,sizeof channels,16,busy);
+  probe.report("surveyChannels() 6ch x 16");
+
+  radio.powerDown();
+  probe.report("powerDown()");
+
+  radio.startListening();
+  probe.report("startListening()");
+
+  uint8_t rx[32];
+  nrf24emu.deliver(1,data1,sizeof data1);
+  while ( radio.available() )
+    radio.read(rx,radio.getDynamicPayloadSize());
+  probe.report("available() + read() 5B");
+
+  radio.stopListening();
+  probe.report("stopListening()");
+
+  printf("\nimage: %u bytes, restored warm %s, cold %s\n",(unsigned) sizeof image,
+         warm ? "ok" : "FAILED",cold ? "ok" : "FAILED");
+  printf("constexpr image %s configure(), restored %s\n",
+         same_image(image,bench_image) ? "matches" : "DIFFERS from",flash ? "ok" : "FAILED");
+  printf("saved by register shadow: %u transactions\n",
+         (unsigned) radio.getSavedTransactions());
+  printf("TX before oscillator settled: %u\n",
+         (unsigned) nrf24emu.counters.early_tx);
+  printf("ack payload: %u bytes, param %u = %u\n",downlink_len,downlink[1],
+         downlink[2] | ( downlink[3] << 8 ));
+  printf("survey picked channel %u, busy", best);
+  for ( uint8_t i = 0; i < sizeof channels; i++ )
+    printf(" %u:%u",channels[i],busy[i]);
+  printf("\n");
+  bool variant_ok = variant_run();
+
+  printf("\n%-28s %9s %6s %9s\n","link control, 19B","delivered","tries","uC/deliv");
+  RF24Link link(radio);
+  link_run("near, fixed PA_MAX",loss_near,NULL);
+  link_run("near, RF24Link",loss_near,&link);
+  link_run("rooms away, fixed PA_MAX",loss_rooms,NULL);
+  link_run("rooms away, RF24Link",loss_rooms,&link);
+  link_run("far, fixed PA_MAX",loss_far,NULL);
+  link_run("far, RF24Link",loss_far,&link);
+  bool ard_ok = ard_run();
+  bool burst_ok = burst_irq_run();
+
+  printf("\n%-28s %9s %6s %9s %7s %7s\n","telemetry, 19B","delivered","tries","uC/deliv","avg_us","max_us");
+  const uint8_t losses[] = { 0, 10, 30, 50 };
+  for ( uint8_t i = 0; i < sizeof losses; i++ )
+  {
+    copies_run(losses[i],0);
+    copies_run(losses[i],1);
+    copies_run(losses[i],2);
+    copies_run(losses[i],3);
+  }
+
+  printf("\nlink statistics, 200 sends of 19B per line\n");
+  printf("%-9s %4s %3s  %-17s  %-17s  %3s %s\n","","fast","slow","ARC 0/1/2/5/10/+","ack ms 1/2/4/8/16/+","err","plos");
+  stats_run();
+
+  printf("\nfirmware update, %u pages of %uB at 2MBPS, flash %uus per page\n",224,OTA_PAGE_SIZE,OTA_PAGE_US);
+  printf("%-9s %8s %8s %8s %8s %6s\n","","ms/page","link","serial","piped","resent");
+  printf("%-9s %8s %8s %8s %8s\n","","","KB/s","KB/s","KB/s");
+  for ( uint8_t i = 0; i < sizeof losses; i++ )
+    ota_run(losses[i]);
+
+  printf("\ndriver instrumentation:\n");
+  radio.printStats();
+
+  return ! ( ard_ok && burst_ok && variant_ok );
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -0,0 +1,142 @@
+/**
+ * @file sealbench.cpp
+ *
+ * Checks of the frame sealing in common/seal.c, and its cost in
+ * permutations per frame.
+ *
+ * Every frame length is sealed and opened again, every bit of every
+ * sealed frame is flipped once and must be rejected, and a replayed
+ * counter must be refused the way the gateway does.  Host time per frame
+ * only ranks the frame sizes, the AVR figure comes from the "seal"
+ * console command on a node.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/seal.h"
+
+static const uint8_t node_key[SEAL_KEY_SIZE] =
+{
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+/****************************************************************************/
+
+// Gateway side: a frame counts once its counter is above the last one
+struct Gateway
+{
+  seal_key_t key;
+  uint32_t last;
+  bool seen;
+
+  Gateway(void): last(0), seen(false) { seal_init(&key,node_key); }
+
+  int receive(uint8_t* frame, uint8_t len)
+  {
+    uint32_t counter;
+    int len_open = seal_open(&key,frame,len,&counter);
+    if ( len_open < 0 || ( seen && counter <= last ) )
+      return -1;
+    last = counter;
+    seen = true;
+    return len_open;
+  }
+};
+
+/****************************************************************************/
+
+static unsigned permutations(uint8_t data)
+{
+  return ( data + 15 ) / 16 + ( data + 8 + 15 ) / 16;
+}
+
+/****************************************************************************/
+
+int main(void)
+{
+  seal_key_t key;
+  seal_init(&key,node_key);
+
+  const uint8_t max_plain = 32 - SEAL_OVERHEAD;
+  unsigned round_trips = 0, bad_round_trips = 0, flips = 0, forged = 0;
+  uint32_t counter = 1;
+
+  for ( uint8_t len = SEAL_HEADER_SIZE; len <= max_plain; len++ )
+  {
+    uint8_t plain[32] = {100, 1, 4};
+    for ( uint8_t i = SEAL_HEADER_SIZE; i < len; i++ )
+      plain[i] = i * 37;
+
+    uint8_t frame[32];
+    memcpy(frame,plain,len);
+    uint8_t sealed_len = seal(&key,frame,len,counter);
+    uint8_t sealed[32];
+    memcpy(sealed,frame,sealed_len);
+
+    uint32_t got;
+    round_trips++;
+    if ( seal_open(&key,frame,sealed_len,&got) != len || got != counter || memcmp(frame,plain,len) )
+      bad_round_trips++;
+
+    for ( unsigned bit = 0; bit < sealed_len * 8u; bit++ )
+    {
+      memcpy(frame,sealed,sealed_len);
+      frame[bit / 8] ^= 1 << ( bit % 8 );
+      flips++;
+      if ( seal_open(&key,frame,sealed_len,&got) >= 0 )
+        forged++;
+    }
+    counter++;
+  }
+
+  printf("round trips: %u, %u wrong\n",round_trips,bad_round_trips);
+  printf("single bit flips: %u, %u accepted\n",flips,forged);
+
+  // The same frame twice, then an older one
+  Gateway gateway;
+  uint8_t reading[32] = {100, 1, 1, 0, 215};
+  uint8_t first[32], again[32], older[32];
+  memcpy(first,reading,5);
+  uint8_t len = seal(&key,first,5,100);
+  memcpy(again,first,len);
+  memcpy(older,reading,5);
+  seal(&key,older,5,99);
+  int a = gateway.receive(first,len);
+  int b = gateway.receive(again,len);
+  int c = gateway.receive(older,len);
+  printf("replay: fresh %s, same again %s, older counter %s\n",
+         a > 0 ? "accepted" : "REJECTED",b > 0 ? "ACCEPTED" : "rejected",c > 0 ? "ACCEPTED" : "rejected");
+
+  printf("\n%-24s %5s %6s %12s\n","frame","data","perms","host ns");
+  const struct { const char* name; uint8_t data; } sizes[] =
+  {
+    { "temperature reading", 2 },
+    { "channel proposal", 1 },
+    { "link report", 12 },
+    { "full batch frame", max_plain - SEAL_HEADER_SIZE },
+  };
+  for ( unsigned s = 0; s < sizeof sizes / sizeof sizes[0]; s++ )
+  {
+    const unsigned runs = 100000;
+    uint8_t frame[32] = {100, 1, 4};
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for ( unsigned i = 0; i < runs; i++ )
+    {
+      frame[2] = 4;
+      seal(&key,frame,SEAL_HEADER_SIZE + sizes[s].data,i);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    double ns = ( ( t1.tv_sec - t0.tv_sec ) * 1e9 + ( t1.tv_nsec - t0.tv_nsec ) ) / runs;
+
+    printf("%-24s %5u %6u %12.0f\n",sizes[s].name,sizes[s].data,permutations(sizes[s].data),ns);
+  }
+
+  return bad_round_trips || forged || a <= 0 || b > 0 || c > 0;
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -0,0 +1,149 @@
+/**
+ * @file tracedump.cpp
+ *
+ * Timeline from a binary trace dump, see common/trace.h.
+ *
+ * Usage: tracedump capture
+ *
+ * The capture is whatever the serial terminal logged after the "trace"
+ * console command; anything before the "TRC1" magic is skipped.  Times are
+ * milliseconds of Timer1, i.e. of time the node was awake, counted from
+ * the oldest record.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../common/trace_events.h"
+
+#define TRACE_NAME(name, doc) #name,
+#define TRACE_DOC(name, doc) doc,
+static const char* const event_name[] = { TRACE_EVENTS(TRACE_NAME) };
+static const char* const event_doc[] = { TRACE_EVENTS(TRACE_DOC) };
+static const unsigned event_count = sizeof event_name / sizeof event_name[0];
+
+const double tick_ms = 0.128;
+
+/****************************************************************************/
+
+// _crc16_update() of avr-libc
+static uint16_t crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for ( int i = 0; i < 8; i++ )
+    crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xa001 : crc >> 1;
+  return crc;
+}
+
+/****************************************************************************/
+
+struct Reader
+{
+  const std::vector<uint8_t>& buf;
+  size_t pos;
+  uint16_t crc;
+
+  Reader(const std::vector<uint8_t>& b, size_t p): buf(b), pos(p), crc(0xffff) {}
+
+  bool left(size_t n) const { return pos + n <= buf.size(); }
+
+  uint8_t byte(void)
+  {
+    uint8_t v = buf[pos++];
+    crc = crc16_update(crc,v);
+    return v;
+  }
+
+  uint16_t word(void)
+  {
+    uint16_t lo = byte();
+    return lo | ( byte() << 8 );
+  }
+};
+
+/****************************************************************************/
+
+int main(int argc, char** argv)
+{
+  if ( argc != 2 )
+  {
+    fprintf(stderr,"usage: %s capture\n",argv[0]);
+    return 2;
+  }
+
+  FILE* f = fopen(argv[1],"rb");
+  if ( ! f )
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> buf;
+  int c;
+  while ( ( c = fgetc(f) ) != EOF )
+    buf.push_back(c);
+  fclose(f);
+
+  size_t start = 0;
+  while ( start + 4 <= buf.size() && memcmp(&buf[start],"TRC1",4) )
+    start++;
+  if ( start + 4 > buf.size() )
+  {
+    fprintf(stderr,"%s: no trace dump found\n",argv[1]);
+    return 1;
+  }
+
+  Reader in(buf,start + 4);
+  if ( ! in.left(6) )
+  {
+    fprintf(stderr,"%s: dump cut short\n",argv[1]);
+    return 1;
+  }
+  unsigned size = in.byte();
+  unsigned seq = in.word();
+  uint16_t now = in.word();
+  unsigned n = in.byte();
+  if ( ! in.left(n * 5 + 2) )
+  {
+    fprintf(stderr,"%s: dump cut short\n",argv[1]);
+    return 1;
+  }
+
+  printf("%u records of %u, %u written since boot\n\n",n,size,seq);
+  printf("%10s %9s  %-11s %6s\n","ms","+ms","event","arg");
+
+  uint32_t elapsed = 0;
+  uint16_t last = 0;
+  for ( unsigned i = 0; i < n; i++ )
+  {
+    uint16_t time = in.word();
+    uint8_t id = in.byte();
+    uint16_t arg = in.word();
+
+    // Consecutive records are less than one Timer1 wrap apart
+    uint16_t delta = i ? (uint16_t) ( time - last ) : 0;
+    elapsed += delta;
+    last = time;
+
+    if ( id < event_count )
+      printf("%10.1f %9.1f  %-11s %6u  0x%04x  %s\n",elapsed * tick_ms,delta * tick_ms,
+             event_name[id],arg,arg,event_doc[id]);
+    else
+      printf("%10.1f %9.1f  #%-10u %6u  0x%04x\n",elapsed * tick_ms,delta * tick_ms,id,arg,arg);
+  }
+  if ( n )
+    printf("%10.1f %9.1f  (dump)\n",( elapsed + (uint16_t) ( now - last ) ) * tick_ms,
+           (uint16_t) ( now - last ) * tick_ms);
+
+  uint16_t crc = in.crc;
+  uint16_t sent = buf[in.pos] | ( buf[in.pos + 1] << 8 );
+  if ( crc != sent )
+  {
+    fprintf(stderr,"CRC mismatch, %04x sent, %04x computed\n",sent,crc);
+    return 1;
+  }
+  return 0;
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
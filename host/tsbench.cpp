@@ -0,0 +1,138 @@
+/**
+ * @file tsbench.cpp
+ *
+ * Compression of the batch frame codec on temperature/humidity traces.
+ *
+ * Usage: tsbench [trace...]
+ *
+ * A trace holds one sample per line, temperature and humidity in tenths
+ * as the node measures them ("215 553", commas work too).  Without a file
+ * the bench runs on a synthetic week at 5 minute intervals.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+extern "C" {
+#include "../common/tscodec.h"
+}
+#include "tsdecode.h"
+
+// Same split as src/batch.h
+const uint8_t frame_size = 32;
+const uint8_t header_size = 5;
+
+typedef std::vector<int16_t> Trace;
+
+/****************************************************************************/
+
+static bool load(const char* path, Trace& trace)
+{
+  FILE* f = fopen(path,"r");
+  if ( ! f )
+    return false;
+
+  char line[128];
+  while ( fgets(line,sizeof line,f) )
+  {
+    int t, h;
+    if ( sscanf(line,"%d%*[ ,;\t]%d",&t,&h) == 2 )
+    {
+      trace.push_back(t);
+      trace.push_back(h);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/****************************************************************************/
+
+static void synthesize(Trace& trace)
+{
+  // Daily swing indoors, DHT22 steps of 0.1 and a little sensor noise
+  srand(1);
+  const int samples = 7 * 24 * 12;
+  for ( int i = 0; i < samples; i++ )
+  {
+    double day = 2 * M_PI * i / ( 24 * 12 );
+    int t = lround(215 + 25 * sin(day) + ( rand() % 3 - 1 ));
+    int h = lround(550 - 60 * sin(day) + ( rand() % 7 - 3 ));
+    trace.push_back(t);
+    trace.push_back(h);
+  }
+}
+
+/****************************************************************************/
+
+static void run(const char* name, const Trace& trace)
+{
+  size_t samples = trace.size() / 2;
+  size_t frames = 0, bytes = 0, mismatches = 0;
+  uint8_t fewest = 0xff, most = 0;
+
+  for ( size_t next = 0; next < samples; frames++ )
+  {
+    uint8_t buf[frame_size - header_size];
+    ts_encoder_t enc;
+
+    ts_encoder_init(&enc,buf,sizeof buf);
+    while ( next + enc.count < samples && ts_encode(&enc,&trace[2 * ( next + enc.count )],2) )
+      ;
+
+    int16_t out[2 * sizeof buf * 2];
+    if ( ! ts_decode(buf,ts_encoded_length(&enc),2,enc.count,out) )
+      mismatches += enc.count;
+    else
+      for ( uint8_t i = 0; i < 2 * enc.count; i++ )
+        mismatches += out[i] != trace[2 * next + i];
+
+    if ( enc.count < fewest && next + enc.count < samples )
+      fewest = enc.count;
+    if ( enc.count > most )
+      most = enc.count;
+
+    bytes += header_size + ts_encoded_length(&enc);
+    next += enc.count;
+  }
+
+  if ( fewest == 0xff )
+    fewest = most;
+
+  printf("%s: %zu samples, %zu frames, %u..%u samples per full frame\n",name,samples,frames,fewest,most);
+  printf("  codec         %6.2f B/sample  %5.1f samples/frame\n",
+         (double) bytes / samples,(double) samples / frames);
+  printf("  3 byte packed %6.2f B/sample  %5u samples/frame\n",
+         (double) ( frame_size ) / ( ( frame_size - header_size ) / 3 ),( frame_size - header_size ) / 3);
+  printf("  2x5B packets  %6.2f B/sample  %5u samples/frame\n",10.0,1);
+  printf("  round trip    %s\n",mismatches ? "MISMATCH" : "ok");
+}
+
+/****************************************************************************/
+
+int main(int argc, char** argv)
+{
+  if ( argc < 2 )
+  {
+    Trace trace;
+    synthesize(trace);
+    run("synthetic week",trace);
+    return 0;
+  }
+
+  for ( int i = 1; i < argc; i++ )
+  {
+    Trace trace;
+    if ( ! load(argv[i],trace) || trace.empty() )
+    {
+      fprintf(stderr,"%s: no samples\n",argv[i]);
+      return 1;
+    }
+    run(argv[i],trace);
+  }
+  return 0;
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -0,0 +1,53 @@
+/**
+ * @file tsdecode.cpp
+ *
+ * Host side decoder for frames written by the common/tscodec.c encoder
+ */
+
+#include "tsdecode.h"
+
+/****************************************************************************/
+
+static bool read_varint(const uint8_t* buf, uint8_t len, uint16_t& pos, uint16_t& value)
+{
+  uint8_t shift = 0;
+  value = 0;
+
+  while ( pos < 2 * len && shift < 18 )
+  {
+    uint8_t nibble = ( pos & 1 ) ? buf[pos >> 1] & 0x0f : buf[pos >> 1] >> 4;
+    pos++;
+
+    value |= ( nibble & 0x07 ) << shift;
+    shift += 3;
+
+    if ( ! ( nibble & 0x08 ) )
+      return true;
+  }
+  return false;
+}
+
+/****************************************************************************/
+
+bool ts_decode(const uint8_t* buf, uint8_t len, uint8_t channels, uint8_t count, int16_t* out)
+{
+  uint16_t pos = 0;
+
+  for ( uint8_t s = 0; s < count; s++ )
+  {
+    for ( uint8_t c = 0; c < channels; c++ )
+    {
+      uint16_t coded;
+      if ( ! read_varint(buf,len,pos,coded) )
+        return false;
+
+      int16_t value = ( coded >> 1 ) ^ -( coded & 1 );
+      if ( s )
+        value += out[( s - 1 ) * channels + c];
+      out[s * channels + c] = value;
+    }
+  }
+  return true;
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
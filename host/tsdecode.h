@@ -0,0 +1,24 @@
+/**
+ * @file tsdecode.h
+ *
+ * Host side decoder for frames written by the common/tscodec.c encoder.
+ */
+
+#ifndef TSDECODE_H_
+#define TSDECODE_H_
+
+#include <stdint.h>
+
+/**
+ * Decode @p count samples of @p channels values each
+ *
+ * @param buf Coded samples, the frame without its header
+ * @param len Bytes in @p buf
+ * @param channels Values per sample, as passed to ts_encode()
+ * @param count Samples in the frame
+ * @param out Room for @p count * @p channels values, sample after sample
+ * @return True if @p buf held all the samples
+ */
+bool ts_decode(const uint8_t* buf, uint8_t len, uint8_t channels, uint8_t count, int16_t* out);
+
+#endif /* TSDECODE_H_ */
@@ -6,15 +6,66 @@
  version 2 as published by the Free Software Foundation.
  */
 
+#ifndef __HARDWARE_PLATFORM_H__
+#define __HARDWARE_PLATFORM_H__
+
+/* ============================================== */
+// The platform is picked at compile time and every method below is inline,
+// so pin toggles and byte transfers end up as plain port instructions at
+// the call site.  Another platform comes from the build, e.g. the host
+// one with -DHARDWARE_PLATFORM_HEADER='"host_platform.h"' and its directory
+// on the include path.
+#if defined(HARDWARE_PLATFORM_HEADER)
+#include HARDWARE_PLATFORM_HEADER
+#elif defined(__AVR__)
 #include "atmega328.h"
+#else
+#error "no hardware platform, define HARDWARE_PLATFORM_HEADER"
+#endif
 #include <string.h>
 
 /* ============================================== */
-#define IF_SERIAL_DEBUG(x) x
+#if defined(__AVR__)
+// Strings stay in flash (avr/pgmspace.h via atmega328.h), %S prints one
+#define PRIPSTR "%S"
+#else
 #define printf_P printf
 #define strlen_P strlen
+#define pgm_read_word(p) (*(p))
 #define PRIPSTR "%s"
 #define PSTR(x) x
+#define PROGMEM
+#endif
+
+/* ============================================== */
+// Build with -DRF24_INSTRUMENT=1 to count bus traffic and radio outcomes.
+// Disabled, RF24_STATS() expands to nothing and rf24_stats does not exist.
+#ifndef RF24_INSTRUMENT
+#define RF24_INSTRUMENT 0
+#endif
+
+#if RF24_INSTRUMENT
+typedef struct {
+	uint32_t spi_bytes;         // bytes clocked, queued jobs included
+	uint16_t csn_transactions;  // CSN framed transactions
+	uint16_t tx_ok;             // payloads acknowledged
+	uint16_t tx_fail;           // payloads dropped after MAX_RT
+	uint16_t arc_total;         // ARC_CNT summed over all sends
+	uint8_t arc_last;           // ARC_CNT of the last send
+	uint8_t plos_last;          // PLOS_CNT after the last send
+	uint16_t tx_started;        // tick the pending send started
+	uint32_t tx_ticks;          // Timer1 ticks spent in sends
+	uint16_t tx_ticks_max;      // longest single send
+	uint16_t begin_ticks;       // duration of the last begin()
+	uint32_t on_ticks;          // Timer1 ticks the radio spent out of power down
+} rf24_stats_t;
+
+extern rf24_stats_t rf24_stats;
+
+#define RF24_STATS(x) do { x; } while (0)
+#else
+#define RF24_STATS(x) do {} while (0)
+#endif
 
 /* ============================================== */
 class HardwarePlatform {
@@ -23,8 +74,82 @@ public:
 	void csn(uint8_t value);
 	void ce(uint8_t value);
 	void initSPI();
+	void initIRQ();
 	uint8_t spiTransfer(uint8_t tx_);
-	void delayMicroseconds(uint64_t micros);
-	void delayMilliseconds(uint64_t milisec);
+	void spiTransferBuffer(const uint8_t* tx, uint8_t* rx, uint8_t len);
+	void spiWriteBuffer(const uint8_t* tx, uint8_t len);
+	bool spiQueue(spi_job_t* job);
+	bool spiQueueIdle();
+	void delayMicroseconds(uint16_t micros);
+	void delayMilliseconds(uint16_t milisec);
+	uint16_t ticks();
+	void readFlash(void* dst, const void* src, uint8_t len);
 };
 
+/* ======================================================= */
+inline void HardwarePlatform::initIO() {
+	setup_io();
+}
+
+inline void HardwarePlatform::initSPI() {
+	setup_spi();
+}
+
+inline void HardwarePlatform::initIRQ() {
+	setup_irq();
+}
+
+inline void HardwarePlatform::csn(uint8_t value) {
+	if (!value) {
+		// let queued jobs finish before a synchronous transaction
+		spi_queue_wait();
+		RF24_STATS(rf24_stats.csn_transactions++);
+	}
+	setCSN(value);
+}
+
+inline void HardwarePlatform::ce(uint8_t value) {
+	setCE(value);
+}
+
+inline uint8_t HardwarePlatform::spiTransfer(uint8_t tx_) {
+	RF24_STATS(rf24_stats.spi_bytes++);
+	return transfer_spi(tx_);
+}
+
+inline void HardwarePlatform::spiTransferBuffer(const uint8_t* tx, uint8_t* rx, uint8_t len) {
+	RF24_STATS(rf24_stats.spi_bytes += len);
+	transfer_spi_buffer(tx, rx, len);
+}
+
+inline void HardwarePlatform::spiWriteBuffer(const uint8_t* tx, uint8_t len) {
+	RF24_STATS(rf24_stats.spi_bytes += len);
+	write_spi_buffer(tx, len);
+}
+
+inline bool HardwarePlatform::spiQueue(spi_job_t* job) {
+	RF24_STATS(rf24_stats.csn_transactions++; rf24_stats.spi_bytes += 1 + job->len + job->pad);
+	return spi_queue_push(job);
+}
+
+inline bool HardwarePlatform::spiQueueIdle() {
+	return spi_queue_idle();
+}
+
+inline void HardwarePlatform::delayMicroseconds(uint16_t micros) {
+	platform_delay_us(micros);
+}
+
+inline void HardwarePlatform::delayMilliseconds(uint16_t milisec) {
+	platform_delay_ms(milisec);
+}
+
+inline uint16_t HardwarePlatform::ticks() {
+	return platform_ticks();
+}
+
+inline void HardwarePlatform::readFlash(void* dst, const void* src, uint8_t len) {
+	platform_read_flash(dst, src, len);
+}
+
+#endif // __HARDWARE_PLATFORM_H__
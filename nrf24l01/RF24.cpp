@@ -8,11 +8,59 @@
  version 2 as published by the Free Software Foundation.
  */
 
+#include <stddef.h>
+
+#include "../common/log.h"
+#include "../common/trace.h"
 #include "nRF24L01.h"
 #include "RF24.h"
+#include "RF24Timing.h"
 
 HardwarePlatform HP;
 
+#if RF24_INSTRUMENT
+rf24_stats_t rf24_stats;
+
+static void record_send(uint8_t observe_tx, uint8_t ok, uint8_t fail)
+{
+  uint16_t ticks = HP.ticks() - rf24_stats.tx_started;
+
+  rf24_stats.tx_ok += ok;
+  rf24_stats.tx_fail += fail;
+  rf24_stats.arc_last = ( observe_tx >> ARC_CNT ) & B1111;
+  rf24_stats.plos_last = ( observe_tx >> PLOS_CNT ) & B1111;
+  rf24_stats.arc_total += rf24_stats.arc_last;
+  rf24_stats.tx_ticks += ticks;
+  if ( ticks > rf24_stats.tx_ticks_max )
+    rf24_stats.tx_ticks_max = ticks;
+}
+#endif
+
+/****************************************************************************/
+
+// Configuration registers mirrored in RF24::shadow, in restore order.
+// FEATURE goes before DYNPD, the latter only sticks with EN_DPL set.
+static const uint8_t shadow_register[RF24_SHADOW_SIZE] =
+{
+  CONFIG,
+  EN_AA,
+  EN_RXADDR,
+  SETUP_AW,
+  SETUP_RETR,
+  RF_CH,
+  RF_SETUP,
+  FEATURE,
+  DYNPD
+};
+
+uint8_t RF24::shadow_index(uint8_t reg)
+{
+  uint8_t index = 0;
+  while ( index < RF24_SHADOW_SIZE && shadow_register[index] != reg )
+    index++;
+  return index;
+}
+
 /****************************************************************************/
 
 uint8_t RF24::read_register(uint8_t reg, uint8_t* buf, uint8_t len)
@@ -21,9 +69,7 @@ uint8_t RF24::read_register(uint8_t reg, uint8_t* buf, uint8_t len)
 
   HP.csn(LOW);
   status = HP.spiTransfer( R_REGISTER | ( REGISTER_MASK & reg ) );
-  while ( len-- )
-    *buf++ = HP.spiTransfer(0xff);
-
+  HP.spiTransferBuffer(NULL,buf,len);
   HP.csn(HIGH);
 
   return status;
@@ -33,12 +79,14 @@ uint8_t RF24::read_register(uint8_t reg, uint8_t* buf, uint8_t len)
 
 uint8_t RF24::read_register(uint8_t reg)
 {
-  HP.csn(LOW);
-  HP.spiTransfer( R_REGISTER | ( REGISTER_MASK & reg ) );
-  uint8_t result = HP.spiTransfer(0xff);
+  uint8_t tx[2] = { static_cast<uint8_t>( R_REGISTER | ( REGISTER_MASK & reg ) ), 0xff };
+  uint8_t rx[2];
 
+  HP.csn(LOW);
+  HP.spiTransferBuffer(tx,rx,sizeof tx);
   HP.csn(HIGH);
-  return result;
+
+  return rx[1];
 }
 
 /****************************************************************************/
@@ -49,9 +97,7 @@ uint8_t RF24::write_register(uint8_t reg, const uint8_t* buf, uint8_t len)
 
   HP.csn(LOW);
   status = HP.spiTransfer( W_REGISTER | ( REGISTER_MASK & reg ) );
-  while ( len-- )
-    HP.spiTransfer(*buf++);
-
+  HP.spiWriteBuffer(buf,len);
   HP.csn(HIGH);
 
   return status;
@@ -61,16 +107,46 @@ uint8_t RF24::write_register(uint8_t reg, const uint8_t* buf, uint8_t len)
 
 uint8_t RF24::write_register(uint8_t reg, uint8_t value)
 {
-  uint8_t status;
+  uint8_t tx[2] = { static_cast<uint8_t>( W_REGISTER | ( REGISTER_MASK & reg ) ), value };
+  uint8_t rx[2];
 
-  IF_SERIAL_DEBUG(printf_P(PSTR("write_register(%02x,%02x)\r\n"),reg,value));
+  log_debug(RADIO,"write_register(%02x,%02x)",reg,value);
 
   HP.csn(LOW);
-  status = HP.spiTransfer( W_REGISTER | ( REGISTER_MASK & reg ) );
-  HP.spiTransfer(value);
+  HP.spiTransferBuffer(tx,rx,sizeof tx);
   HP.csn(HIGH);
 
-  return status;
+  uint8_t index = shadow_index(reg);
+  if ( index < RF24_SHADOW_SIZE )
+    shadow[index] = value;
+
+  if ( reg == CONFIG )
+    track_config(value);
+
+  return rx[0];
+}
+
+/****************************************************************************/
+
+void RF24::update_register(uint8_t reg, uint8_t value)
+{
+  uint8_t index = shadow_index(reg);
+  if ( index < RF24_SHADOW_SIZE && shadow[index] == value )
+    spi_saved++;
+  else
+    write_register(reg,value);
+}
+
+/****************************************************************************/
+
+uint8_t RF24::read_shadow(uint8_t reg)
+{
+  uint8_t index = shadow_index(reg);
+  if ( index >= RF24_SHADOW_SIZE )
+    return read_register(reg);
+
+  spi_saved++;
+  return shadow[index];
 }
 
 /****************************************************************************/
@@ -88,10 +164,8 @@ uint8_t RF24::write_payload(const void* buf, uint8_t len, const uint8_t writeTyp
 
   HP.csn(LOW);
   status = HP.spiTransfer( writeType );
-  while ( data_len-- )
-    HP.spiTransfer(*current++);
-  while ( blank_len-- )
-    HP.spiTransfer(0);
+  HP.spiWriteBuffer(current,data_len);
+  HP.spiWriteBuffer(NULL,blank_len);
   HP.csn(HIGH);
 
   return status;
@@ -111,10 +185,8 @@ uint8_t RF24::read_payload(void* buf, uint8_t len)
   
   HP.csn(LOW);
   status = HP.spiTransfer( R_RX_PAYLOAD );
-  while ( data_len-- )
-    *current++ = HP.spiTransfer(0xff);
-  while ( blank_len-- )
-    HP.spiTransfer(0xff);
+  HP.spiTransferBuffer(NULL,current,data_len);
+  HP.spiTransferBuffer(NULL,NULL,blank_len);
   HP.csn(HIGH);
 
   return status;
@@ -189,7 +261,7 @@ void RF24::print_observe_tx(uint8_t value)
 void RF24::print_byte_register(const char* name, uint8_t reg, uint8_t qty)
 {
   char extra_tab = strlen_P(name) < 8 ? '\t' : 0;
-  printf_P(PSTR(PRIPSTR"\t%c ="),name,extra_tab);
+  printf_P(PSTR(PRIPSTR "\t%c ="),name,extra_tab);
   while (qty--)
     printf_P(PSTR(" 0x%02x"),read_register(reg++));
   printf_P(PSTR("\r\n"));
@@ -200,7 +272,7 @@ void RF24::print_byte_register(const char* name, uint8_t reg, uint8_t qty)
 void RF24::print_address_register(const char* name, uint8_t reg, uint8_t qty)
 {
   char extra_tab = strlen_P(name) < 8 ? '\t' : 0;
-  printf_P(PSTR(PRIPSTR"\t%c ="),name,extra_tab);
+  printf_P(PSTR(PRIPSTR "\t%c ="),name,extra_tab);
 
   while (qty--)
   {
@@ -225,8 +297,18 @@ RF24::RF24():
   ack_payload_available(false),
   dynamic_payloads_enabled(false),
   ack_payload_length(0),
-  pipe0_reading_address(0)
+  pipe0_reading_address(0),
+  tx_pending(false),
+  burst_count(0),
+  burst_delivered(0),
+  spi_saved(0),
+  state(RF24_POWER_DOWN),
+  state_since(0),
+  tx_ticks(0),
+  powered_at(0),
+  powering_up(false)
 {
+  memset(shadow,0,sizeof shadow);
 }
 
 /****************************************************************************/
@@ -237,7 +319,7 @@ void RF24::setChannel(uint8_t channel)
   // done in setChannel() to require certain channel spacing.
 
   const uint8_t max_channel = 127;
-  write_register(RF_CH,MIN(channel,max_channel));
+  update_register(RF_CH,MIN(channel,max_channel));
 
 }
 
@@ -245,7 +327,7 @@ void RF24::setChannel(uint8_t channel)
 
 uint8_t RF24::getChannel( void )
 {
-  return read_register( RF_CH );
+  return read_shadow( RF_CH );
 }
 
 /****************************************************************************/
@@ -265,33 +347,33 @@ uint8_t RF24::getPayloadSize(void)
 
 /****************************************************************************/
 
-static const char rf24_datarate_e_str_0[] = "1MBPS";
-static const char rf24_datarate_e_str_1[] = "2MBPS";
-static const char rf24_datarate_e_str_2[] = "250KBPS";
-static const char * const rf24_datarate_e_str_P[] = {
+static const char rf24_datarate_e_str_0[] PROGMEM = "1MBPS";
+static const char rf24_datarate_e_str_1[] PROGMEM = "2MBPS";
+static const char rf24_datarate_e_str_2[] PROGMEM = "250KBPS";
+static const char * const rf24_datarate_e_str_P[] PROGMEM = {
   rf24_datarate_e_str_0,
   rf24_datarate_e_str_1,
   rf24_datarate_e_str_2,
 };
-static const char rf24_model_e_str_0[] = "nRF24L01";
-static const char rf24_model_e_str_1[] = "nRF24L01+";
-static const char * const rf24_model_e_str_P[] = {
+static const char rf24_model_e_str_0[] PROGMEM = "nRF24L01";
+static const char rf24_model_e_str_1[] PROGMEM = "nRF24L01+";
+static const char * const rf24_model_e_str_P[] PROGMEM = {
   rf24_model_e_str_0,
   rf24_model_e_str_1,
 };
-static const char rf24_crclength_e_str_0[] = "Disabled";
-static const char rf24_crclength_e_str_1[] = "8 bits";
-static const char rf24_crclength_e_str_2[] = "16 bits" ;
-static const char * const rf24_crclength_e_str_P[] = {
+static const char rf24_crclength_e_str_0[] PROGMEM = "Disabled";
+static const char rf24_crclength_e_str_1[] PROGMEM = "8 bits";
+static const char rf24_crclength_e_str_2[] PROGMEM = "16 bits" ;
+static const char * const rf24_crclength_e_str_P[] PROGMEM = {
   rf24_crclength_e_str_0,
   rf24_crclength_e_str_1,
   rf24_crclength_e_str_2,
 };
-static const char rf24_pa_dbm_e_str_0[] = "PA_MIN";
-static const char rf24_pa_dbm_e_str_1[] = "PA_LOW";
-static const char rf24_pa_dbm_e_str_2[] = "PA_HIGH";
-static const char rf24_pa_dbm_e_str_3[] = "PA_MAX";
-static const char * const rf24_pa_dbm_e_str_P[] = {
+static const char rf24_pa_dbm_e_str_0[] PROGMEM = "PA_MIN";
+static const char rf24_pa_dbm_e_str_1[] PROGMEM = "PA_LOW";
+static const char rf24_pa_dbm_e_str_2[] PROGMEM = "PA_HIGH";
+static const char rf24_pa_dbm_e_str_3[] PROGMEM = "PA_MAX";
+static const char * const rf24_pa_dbm_e_str_P[] PROGMEM = {
   rf24_pa_dbm_e_str_0,
   rf24_pa_dbm_e_str_1,
   rf24_pa_dbm_e_str_2,
@@ -314,16 +396,18 @@ void RF24::printDetails(void)
   print_byte_register(PSTR("CONFIG"),CONFIG);
   print_byte_register(PSTR("DYNPD/FEATURE"),DYNPD,2);
 
-  printf_P(PSTR("Data Rate\t = "PRIPSTR"\r\n"), rf24_datarate_e_str_P[getDataRate()]);
-  printf_P(PSTR("Model\t\t = "PRIPSTR"\r\n"), rf24_model_e_str_P[isPVariant()]);
-  printf_P(PSTR("CRC Length\t = "PRIPSTR"\r\n"), rf24_crclength_e_str_P[getCRCLength()]);
-  printf_P(PSTR("PA Power\t = "PRIPSTR"\r\n"), rf24_pa_dbm_e_str_P[getPALevel()]);
+  printf_P(PSTR("Data Rate\t = " PRIPSTR "\r\n"), (const char*) pgm_read_word(&rf24_datarate_e_str_P[getDataRate()]));
+  printf_P(PSTR("Model\t\t = " PRIPSTR "\r\n"), (const char*) pgm_read_word(&rf24_model_e_str_P[isPVariant()]));
+  printf_P(PSTR("CRC Length\t = " PRIPSTR "\r\n"), (const char*) pgm_read_word(&rf24_crclength_e_str_P[getCRCLength()]));
+  printf_P(PSTR("PA Power\t = " PRIPSTR "\r\n"), (const char*) pgm_read_word(&rf24_pa_dbm_e_str_P[getPALevel()]));
 }
 
 /****************************************************************************/
 
 void RF24::begin(void)
 {
+  RF24_STATS(rf24_stats.begin_ticks = HP.ticks());
+
   // Initialize pins
   HP.initIO();
 
@@ -341,10 +425,12 @@ void RF24::begin(void)
   // WARNING: Delay is based on P-variant whereby non-P *may* require different timing.
   HP.delayMilliseconds( 5 ) ;
 
-  // Set 1500uS (minimum for 32B payload in ESB@250KBPS) timeouts, to make testing a little easier
-  // WARNING: If this is ever lowered, either 250KBS mode with AA is broken or maximum packet
-  // sizes must never be used. See documentation for a more complete explanation.
-  write_register(SETUP_RETR,(B0101 << ARD) | (B1111 << ARC));
+  // The radio keeps its registers across an MCU reset, start from what it has
+  syncRegisters();
+
+  // Start with the retry delay that fits a 32 byte ack payload at 250KBPS,
+  // whatever the application sets up later it can not break the ack
+  write_register(SETUP_RETR,(rf24_ard_code(rf24_min_ard_us(RF24_250KBPS,RF24_MAX_PAYLOAD)) << ARD) | (B1111 << ARC));
 
   // Restore our default PA level
   setPALevel( RF24_PA_MAX ) ;
@@ -353,10 +439,7 @@ void RF24::begin(void)
   // reset our data rate back to default value. This works
   // because a non-P variant won't allow the data rate to
   // be set to 250Kbps.
-  if( setDataRate( RF24_250KBPS ) )
-  {
-    p_variant = true ;
-  }
+  p_variant = setDataRate( RF24_250KBPS ) ;
   
   // Then set the data rate to the slowest (and most reliable) speed supported by all
   // hardware.
@@ -380,14 +463,200 @@ void RF24::begin(void)
   // Flush buffers
   flush_rx();
   flush_tx();
+
+  RF24_STATS(rf24_stats.begin_ticks = HP.ticks() - rf24_stats.begin_ticks);
+}
+
+/****************************************************************************/
+
+static uint16_t image_crc(const rf24_image_t* image)
+{
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(image);
+  uint16_t crc = 0xffff;
+
+  for ( uint8_t i = 0; i < offsetof(rf24_image_t,crc); i++ )
+  {
+    crc ^= (uint16_t) p[i] << 8;
+    for ( uint8_t bit = 0; bit < 8; bit++ )
+      crc = ( crc & 0x8000 ) ? ( crc << 1 ) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+/****************************************************************************/
+
+void RF24::getImage(rf24_image_t* image, uint16_t key)
+{
+  memset(image,0,sizeof *image);
+  image->version = RF24_IMAGE_VERSION;
+  image->key = key;
+
+  memcpy(image->shadow,shadow,sizeof image->shadow);
+  image->shadow[shadow_index(CONFIG)] &= ~( _BV(PWR_UP) | _BV(PRIM_RX) );
+
+  read_register(RX_ADDR_P0,image->rx_addr_p0,5);
+  read_register(RX_ADDR_P1,image->rx_addr_p1,5);
+  read_register(TX_ADDR,image->tx_addr,5);
+  for ( uint8_t i = 0; i < 4; i++ )
+    image->rx_addr_lsb[i] = read_register(RX_ADDR_P2 + i);
+  for ( uint8_t i = 0; i < 6; i++ )
+    image->rx_pw[i] = read_register(RX_PW_P0 + i);
+
+  image->payload_size = payload_size;
+  image->flags = ( p_variant ? RF24_IMAGE_P_VARIANT : 0 ) | ( wide_band ? RF24_IMAGE_WIDE_BAND : 0 )
+    | ( dynamic_payloads_enabled ? RF24_IMAGE_DYNAMIC : 0 );
+  image->pipe0_reading_address = pipe0_reading_address;
+  image->crc = image_crc(image);
+}
+
+/****************************************************************************/
+
+bool RF24::beginFromImage(const rf24_image_t* image, uint16_t key)
+{
+  if ( image->version != RF24_IMAGE_VERSION || image->key != key || image->crc != image_crc(image) )
+    return false;
+
+  return restore_image(image);
+}
+
+/****************************************************************************/
+
+bool RF24::beginFromFlash(const rf24_image_t* image)
+{
+  rf24_image_t copy;
+  HP.readFlash(&copy,image,sizeof copy);
+
+  return restore_image(&copy);
+}
+
+/****************************************************************************/
+
+bool RF24::restore_image(const rf24_image_t* image)
+{
+  RF24_STATS(rf24_stats.begin_ticks = HP.ticks());
+
+  HP.initIO();
+  HP.initSPI();
+  HP.ce(LOW);
+  HP.csn(HIGH);
+
+  memcpy(shadow,image->shadow,sizeof shadow);
+  payload_size = image->payload_size;
+  p_variant = image->flags & RF24_IMAGE_P_VARIANT;
+  wide_band = image->flags & RF24_IMAGE_WIDE_BAND;
+  dynamic_payloads_enabled = image->flags & RF24_IMAGE_DYNAMIC;
+  pipe0_reading_address = image->pipe0_reading_address;
+  state = RF24_POWER_DOWN;
+
+  // Registers written during power on reset do not stick, which the verify
+  // catches.  Only then pay the settling delay begin() always pays.
+  if ( ! restoreRegisters() )
+  {
+    HP.delayMilliseconds( 5 ) ;
+    if ( ! restoreRegisters() )
+    {
+      trace(TRACE_RF_RESTORE,0);
+      return false;
+    }
+  }
+  trace(TRACE_RF_RESTORE,1);
+
+  write_register(RX_ADDR_P0,image->rx_addr_p0,5);
+  write_register(RX_ADDR_P1,image->rx_addr_p1,5);
+  write_register(TX_ADDR,image->tx_addr,5);
+  for ( uint8_t i = 0; i < 4; i++ )
+    write_register(RX_ADDR_P2 + i,image->rx_addr_lsb[i]);
+  for ( uint8_t i = 0; i < 6; i++ )
+    write_register(RX_PW_P0 + i,image->rx_pw[i]);
+
+  write_register(STATUS,_BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) );
+  flush_rx();
+  flush_tx();
+
+  RF24_STATS(rf24_stats.begin_ticks = HP.ticks() - rf24_stats.begin_ticks);
+  return true;
+}
+
+/****************************************************************************/
+
+void RF24::syncRegisters(void)
+{
+  for ( uint8_t i = 0; i < RF24_SHADOW_SIZE; i++ )
+    shadow[i] = read_register(shadow_register[i]);
+
+  // There is no telling how long ago PWR_UP was set, assume just now
+  state = RF24_POWER_DOWN;
+  track_config(shadow[shadow_index(CONFIG)]);
+}
+
+/****************************************************************************/
+
+bool RF24::verifyRegisters(void)
+{
+  for ( uint8_t i = 0; i < RF24_SHADOW_SIZE; i++ )
+  {
+    if ( read_register(shadow_register[i]) != shadow[i] )
+      return false;
+  }
+  return true;
+}
+
+/****************************************************************************/
+
+bool RF24::restoreRegisters(void)
+{
+  for ( uint8_t i = 0; i < RF24_SHADOW_SIZE; i++ )
+    write_register(shadow_register[i],shadow[i]);
+
+  // A power cycled nRF24L01 (non-P) needs ACTIVATE before FEATURE sticks
+  if ( shadow[shadow_index(FEATURE)] && ! read_register(FEATURE) )
+  {
+    toggle_features();
+    write_register(FEATURE,shadow[shadow_index(FEATURE)]);
+    write_register(DYNPD,shadow[shadow_index(DYNPD)]);
+  }
+
+  return verifyRegisters();
+}
+
+/****************************************************************************/
+
+uint8_t RF24::getObserveTx(void)
+{
+  return read_register(OBSERVE_TX);
+}
+
+/****************************************************************************/
+
+#if RF24_INSTRUMENT
+void RF24::printStats(void)
+{
+  printf_P(PSTR("SPI bytes\t = %lu\r\n"),(unsigned long) rf24_stats.spi_bytes);
+  printf_P(PSTR("SPI trans\t = %u\r\n"),rf24_stats.csn_transactions);
+  printf_P(PSTR("Shadow saved\t = %u\r\n"),spi_saved);
+  printf_P(PSTR("TX ok/fail\t = %u/%u\r\n"),rf24_stats.tx_ok,rf24_stats.tx_fail);
+  printf_P(PSTR("ARC last/total\t = %u/%u\r\n"),rf24_stats.arc_last,rf24_stats.arc_total);
+  printf_P(PSTR("PLOS_CNT\t = %u\r\n"),rf24_stats.plos_last);
+  printf_P(PSTR("TX ticks\t = %lu max %u\r\n"),(unsigned long) rf24_stats.tx_ticks,rf24_stats.tx_ticks_max);
+  printf_P(PSTR("begin() ticks\t = %u\r\n"),rf24_stats.begin_ticks);
+  printf_P(PSTR("Radio on ticks\t = %lu\r\n"),(unsigned long) rf24_stats.on_ticks);
+}
+#endif
+
+/****************************************************************************/
+
+uint16_t RF24::getSavedTransactions(void)
+{
+  return spi_saved;
 }
 
 /****************************************************************************/
 
 void RF24::startListening(void)
 {
-  write_register(CONFIG, read_register(CONFIG) | _BV(PWR_UP) | _BV(PRIM_RX));
+  update_register(CONFIG, read_shadow(CONFIG) | _BV(PWR_UP) | _BV(PRIM_RX));
   write_register(STATUS, _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) );
+  wait_standby();
 
   // Restore the pipe0 adddress, if exists
   if (pipe0_reading_address)
@@ -399,6 +668,7 @@ void RF24::startListening(void)
 
   // Go!
   HP.ce(HIGH);
+  set_state(RF24_RX);
 
   // wait for the radio to come up (130us actually only needed)
   HP.delayMicroseconds(130);
@@ -409,6 +679,8 @@ void RF24::startListening(void)
 void RF24::stopListening(void)
 {
   HP.ce(LOW);
+  if ( state == RF24_RX )
+    set_state(RF24_STANDBY_I);
   flush_tx();
   flush_rx();
 }
@@ -417,23 +689,113 @@ void RF24::stopListening(void)
 
 void RF24::powerDown(void)
 {
-  write_register(CONFIG,read_register(CONFIG) & ~_BV(PWR_UP));
+  update_register(CONFIG,read_shadow(CONFIG) & ~_BV(PWR_UP));
 }
 
 /****************************************************************************/
 
 void RF24::powerUp(void)
 {
-  write_register(CONFIG,read_register(CONFIG) | _BV(PWR_UP));
-  HP.delayMicroseconds(150);
+  update_register(CONFIG,read_shadow(CONFIG) | _BV(PWR_UP));
+}
+
+/****************************************************************************/
+
+rf24_state_e RF24::getState(void)
+{
+  return state;
+}
+
+/****************************************************************************/
+
+uint16_t RF24::getStateTicks(void)
+{
+  return HP.ticks() - state_since;
+}
+
+/****************************************************************************/
+
+uint16_t RF24::getSendTicks(void)
+{
+  return tx_ticks;
+}
+
+/****************************************************************************/
+
+void RF24::set_state(rf24_state_e next)
+{
+  uint16_t now = HP.ticks();
+
+  if ( next == RF24_POWER_DOWN && state != RF24_POWER_DOWN )
+    RF24_STATS(rf24_stats.on_ticks += now - powered_at);
+
+  if ( state == RF24_TX && next != RF24_TX )
+    tx_ticks = now - state_since;
+
+  state = next;
+  state_since = now;
+  trace(TRACE_RF_STATE,next);
+}
+
+/****************************************************************************/
+
+void RF24::track_config(uint8_t config)
+{
+  if ( ! ( config & _BV(PWR_UP) ) )
+  {
+    if ( state != RF24_POWER_DOWN )
+      set_state(RF24_POWER_DOWN);
+    powering_up = false;
+  }
+  else if ( state == RF24_POWER_DOWN )
+  {
+    set_state(RF24_STANDBY_I);
+    powered_at = state_since;
+    powering_up = true;
+  }
+}
+
+/****************************************************************************/
+
+void RF24::enter_tx(void)
+{
+  // CE low takes the radio from RX back to Standby-I
+  if ( state == RF24_RX )
+  {
+    HP.ce(LOW);
+    set_state(RF24_STANDBY_I);
+  }
+
+  update_register(CONFIG, ( read_shadow(CONFIG) | _BV(PWR_UP) ) & ~_BV(PRIM_RX) );
+
+  // Standby-I to TX settling (130us) is timed by the radio itself once CE
+  // goes high, only the oscillator start up needs the MCU to wait
+  wait_standby();
+}
+
+/****************************************************************************/
+
+void RF24::wait_standby(void)
+{
+  if ( ! powering_up )
+    return;
+
+  // The tick in progress may have just begun, only count whole ones
+  uint16_t elapsed = HP.ticks() - powered_at;
+  uint16_t waited = elapsed ? elapsed - 1 : 0;
+
+  // _delay_us() takes constants only, wait out the rest a tick at a time
+  const uint16_t needed = ( RF24_POWERUP_US + PLATFORM_TICK_US - 1 ) / PLATFORM_TICK_US;
+  while ( waited++ < needed )
+    HP.delayMicroseconds(PLATFORM_TICK_US);
+
+  powering_up = false;
 }
 
 /******************************************************************/
 
 bool RF24::write( const void* buf, uint8_t len, const bool multicast )
 {
-  bool result = false;
-
   // Begin the write
   startWrite( buf, len, multicast );
 
@@ -449,55 +811,83 @@ bool RF24::write( const void* buf, uint8_t len, const bool multicast )
   // Generally much faster.
   uint8_t observe_tx;
   uint8_t status;
-  uint16_t retry = 500;
+  // Poll every 50us.  The budget is time based, not a poll count: twice the
+  // modelled worst case, plus 5ms for the oscillator to settle after power up.
+  uint16_t retry = getMaxTimeout() / 25 + 100;
 
   // Monitor the send
   do
   {
     status = read_register(OBSERVE_TX,&observe_tx,1);
-    IF_SERIAL_DEBUG(printf_P(PSTR("observe_tx = %02x\r\n"),observe_tx));
+    log_debug(RADIO,"observe_tx = %02x",observe_tx);
+    if ( status & ( _BV(TX_DS) | _BV(MAX_RT) ) )
+      break;
+    HP.delayMicroseconds(50);
   }
-  while( ! ( status & ( _BV(TX_DS) | _BV(MAX_RT) ) ) && ( retry-- > 1 ) );
+  while( retry-- > 1 );
 
   // The part above is what you could recreate with your own interrupt handler,
-  // and then call this when you got an interrupt
+  // and then call this when you got an interrupt, see enableIRQ()
   // ------------
 
-  // Call this when you get an interrupt
+  return finishWrite();
+}
+
+/****************************************************************************/
+
+bool RF24::finishWrite(void)
+{
   // The status tells us three things
   // * The send was successful (TX_DS)
   // * The send failed, too many retries (MAX_RT)
   // * There is an ack packet waiting (RX_DR)
   bool tx_ok, tx_fail;
+  HP.ce(LOW);
   whatHappened(tx_ok,tx_fail,ack_payload_available);
+  tx_pending = false;
+  if ( state == RF24_TX )
+    set_state(RF24_STANDBY_I);
 
-  result = tx_ok;
-  IF_SERIAL_DEBUG(printf_P(PSTR(result?"...OK.\r\n":"...Failed\r\n")));
+  RF24_STATS(record_send(read_register(OBSERVE_TX),tx_ok,tx_fail));
+  trace(TRACE_RF_DONE,tx_ok | ( tx_fail << 1 ) | ( ack_payload_available << 2 ));
+
+  // A payload the radio gave up on stays in the TX FIFO and would go out
+  // in place of the next one
+  if ( tx_fail )
+    flush_tx();
+
+  log_debug(RADIO,"..." PRIPSTR,tx_ok ? PSTR("OK.") : PSTR("Failed"));
 
   // Handle the ack packet
   if ( ack_payload_available )
   {
     ack_payload_length = getDynamicPayloadSize();
-    IF_SERIAL_DEBUG(printf_P(PSTR("[AckPacket] ack_payload_length = %d\r\n"),ack_payload_length));
+    log_debug(RADIO,"[AckPacket] ack_payload_length = %d",ack_payload_length);
   }
 
-  return result;
+  return tx_ok;
 }
+
 /****************************************************************************/
 
 void RF24::startWrite( const void* buf, uint8_t len, const bool multicast )
 {
-  // Transmitter power-up
-  write_register(CONFIG, ( read_register(CONFIG) | _BV(PWR_UP) ) & ~_BV(PRIM_RX) );
-  HP.delayMicroseconds(150);
+  // Transmitter power-up, waits only if the oscillator is still starting
+  enter_tx();
 
 
   // Send the payload - Unicast (W_TX_PAYLOAD) or multicast (W_TX_PAYLOAD_NO_ACK)
   write_payload( buf, len,
 		 multicast?static_cast<uint8_t>(W_TX_PAYLOAD_NO_ACK):static_cast<uint8_t>(W_TX_PAYLOAD) ) ;
 
+  // Armed before CE so that a fast IRQ can not be lost
+  tx_pending = true;
+  RF24_STATS(rf24_stats.tx_started = HP.ticks());
+  trace(TRACE_RF_TX,len);
+
   // Allons!
   HP.ce(HIGH);
+  set_state(RF24_TX);
   HP.delayMicroseconds(10);
 
   HP.ce(LOW);
@@ -505,6 +895,216 @@ void RF24::startWrite( const void* buf, uint8_t len, const bool multicast )
 
 /****************************************************************************/
 
+bool RF24::startWriteQueued( spi_job_t* job, const void* buf, uint8_t len, const bool multicast )
+{
+  // Transmitter power-up, waits only if the oscillator is still starting
+  enter_tx();
+
+  uint8_t data_len = MIN(len,payload_size);
+
+  job->cmd = multicast?static_cast<uint8_t>(W_TX_PAYLOAD_NO_ACK):static_cast<uint8_t>(W_TX_PAYLOAD);
+  job->tx = reinterpret_cast<const uint8_t*>(buf);
+  job->rx = NULL;
+  job->len = data_len;
+  job->pad = dynamic_payloads_enabled ? 0 : payload_size - data_len;
+  job->flags = SPI_JOB_CE_HIGH;
+
+  tx_pending = true;
+  RF24_STATS(rf24_stats.tx_started = HP.ticks());
+  trace(TRACE_RF_TX,data_len);
+  if ( ! HP.spiQueue(job) )
+  {
+    tx_pending = false;
+    return false;
+  }
+  set_state(RF24_TX);
+  return true;
+}
+
+/****************************************************************************/
+
+bool RF24::queueRegister( spi_job_t* job, uint8_t reg, const uint8_t* buf, uint8_t len )
+{
+  job->cmd = W_REGISTER | ( REGISTER_MASK & reg );
+  job->tx = buf;
+  job->rx = NULL;
+  job->len = len;
+  job->pad = 0;
+  job->flags = 0;
+
+  if ( ! HP.spiQueue(job) )
+    return false;
+
+  uint8_t index = shadow_index(reg);
+  if ( len == 1 && index < RF24_SHADOW_SIZE )
+    shadow[index] = *buf;
+
+  return true;
+}
+
+/****************************************************************************/
+
+void RF24::startBurst( const void* const* bufs, const uint8_t* lens, uint8_t count )
+{
+  const uint8_t max_burst = 3;
+
+  burst_count = MIN(count,max_burst);
+  burst_delivered = 0;
+
+  // Transmitter power-up, waits only if the oscillator is still starting
+  enter_tx();
+
+  for ( uint8_t i = 0; i < burst_count; i++ )
+    write_payload( bufs[i], lens[i], W_TX_PAYLOAD );
+
+  tx_pending = true;
+  RF24_STATS(rf24_stats.tx_started = HP.ticks());
+
+  // CE stays high until finishBurst(), the radio sends the whole FIFO
+  HP.ce(HIGH);
+  set_state(RF24_TX);
+}
+
+/****************************************************************************/
+
+bool RF24::serviceBurst(void)
+{
+  uint8_t status = get_status();
+
+  // Re-arm before clearing, so the IRQ of the next payload is not lost
+  tx_pending = true;
+
+  // Clear every bit we saw, a set RX_DR from an ack payload would hold the
+  // IRQ line low and no later payload could raise it again
+  status &= _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT);
+  if ( status )
+    write_register(STATUS,status);
+
+  if ( status & _BV(TX_DS) )
+    burst_delivered++;
+
+  if ( status & _BV(RX_DR) )
+    ack_payload_available = true;
+
+  if ( status & _BV(MAX_RT) )
+    return true;
+
+  // Two TX_DS can collapse into one if the IRQ was serviced late, the
+  // FIFO tells the truth
+  if ( burst_delivered < burst_count && ( read_register(FIFO_STATUS) & _BV(TX_EMPTY) ) )
+    burst_delivered = burst_count;
+
+  return burst_delivered >= burst_count;
+}
+
+/****************************************************************************/
+
+uint8_t RF24::finishBurst(void)
+{
+  HP.ce(LOW);
+  tx_pending = false;
+  if ( state == RF24_TX )
+    set_state(RF24_STANDBY_I);
+
+  RF24_STATS(record_send(read_register(OBSERVE_TX),burst_delivered,burst_count - burst_delivered));
+
+  if ( burst_delivered < burst_count )
+    flush_tx();
+
+  write_register(STATUS,_BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) );
+
+  log_debug(RADIO,"[Burst] %d of %d delivered",burst_delivered,burst_count);
+
+  if ( ack_payload_available )
+    ack_payload_length = getDynamicPayloadSize();
+
+  return ( 1 << burst_delivered ) - 1;
+}
+
+/****************************************************************************/
+
+uint8_t RF24::writeBurst( const void* const* bufs, const uint8_t* lens, uint8_t count )
+{
+  startBurst( bufs, lens, count );
+
+  // Poll every 50us, same per payload budget as write()
+  uint16_t polls = burst_count * ( getMaxTimeout() / 25 + 100 );
+
+  while ( polls-- )
+  {
+    if ( ( get_status() & ( _BV(TX_DS) | _BV(MAX_RT) ) ) && serviceBurst() )
+      break;
+    HP.delayMicroseconds(50);
+  }
+
+  return finishBurst();
+}
+
+/****************************************************************************/
+
+uint8_t RF24::writeCopies( const void* buf, uint8_t len, uint8_t copies, uint16_t gap_us )
+{
+  uint8_t address_width = ( read_shadow(SETUP_AW) & B11 ) + 2;
+  uint8_t sent = 0;
+
+  if ( ! ( read_shadow(FEATURE) & _BV(EN_DYN_ACK) ) )
+    enableDynamicAck();
+
+  // Settling and one packet on air, plus margin for the polling
+  uint16_t polls = ( RF24_SETTLE_US
+                     + rf24_airtime_us(getDataRate(),address_width,getCRCLength(),MIN(len,payload_size)) ) / 50 + 4;
+
+  for ( uint8_t i = 0; i < copies; i++ )
+  {
+    // _delay_us() takes constants only, the gap goes in 50us steps
+    if ( i )
+      for ( uint16_t gap = ( gap_us + 49 ) / 50; gap; gap-- )
+        HP.delayMicroseconds(50);
+
+    startWrite( buf, len, true );
+
+    // Poll every 50us, nothing to wait for but TX_DS
+    uint16_t retry = polls;
+    while ( ! ( get_status() & _BV(TX_DS) ) && --retry )
+      HP.delayMicroseconds(50);
+
+    if ( finishWrite() )
+      sent++;
+    else
+    {
+      // The copy never went out, it must not go ahead of the next one
+      flush_tx();
+      write_register(STATUS,_BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT) );
+    }
+  }
+
+  return sent;
+}
+
+/****************************************************************************/
+
+void RF24::enableIRQ(void)
+{
+  HP.initIRQ();
+}
+
+/****************************************************************************/
+
+void RF24::irq(void)
+{
+  tx_pending = false;
+  trace(TRACE_RF_IRQ,0);
+}
+
+/****************************************************************************/
+
+bool RF24::isTxPending(void)
+{
+  return tx_pending;
+}
+
+/****************************************************************************/
+
 uint8_t RF24::getDynamicPayloadSize(void)
 {
   uint8_t result = 0;
@@ -514,6 +1114,13 @@ uint8_t RF24::getDynamicPayloadSize(void)
   result = HP.spiTransfer(0xff);
   HP.csn(HIGH);
 
+  // A width above 32 means the payload is corrupt and has to go
+  if ( result > 32 )
+  {
+    flush_rx();
+    result = 0;
+  }
+
   return result;
 }
 
@@ -531,7 +1138,7 @@ bool RF24::available(uint8_t* pipe_num)
   uint8_t status = get_status();
 
   // Too noisy, enable if you really want lots o data!!
-  //IF_SERIAL_DEBUG(print_status(status));
+  //print_status(status);
 
   bool result = ( status & _BV(RX_DR) );
 
@@ -648,7 +1255,7 @@ void RF24::openReadingPipe(uint8_t child, uint64_t address)
     // Note it would be more efficient to set all of the bits for all open
     // pipes at once.  However, I thought it would make the calling code
     // more simple to do it this way.
-    write_register(EN_RXADDR, read_register(EN_RXADDR) | _BV(child_pipe_enable[child]));
+    update_register(EN_RXADDR, read_shadow(EN_RXADDR) | _BV(child_pipe_enable[child]));
   }
 }
 
@@ -656,7 +1263,7 @@ void RF24::openReadingPipe(uint8_t child, uint64_t address)
 
 void RF24::closeReadingPipe( uint8_t pipe )
 {
-  write_register(EN_RXADDR,read_register(EN_RXADDR) & ~_BV(child_pipe_enable[pipe]));
+  update_register(EN_RXADDR,read_shadow(EN_RXADDR) & ~_BV(child_pipe_enable[pipe]));
 }
 
 /****************************************************************************/
@@ -674,23 +1281,23 @@ void RF24::toggle_features(void)
 void RF24::enableDynamicPayloads(void)
 {
   // Enable dynamic payload throughout the system
-  write_register(FEATURE,read_register(FEATURE) | _BV(EN_DPL) );
+  update_register(FEATURE,read_shadow(FEATURE) | _BV(EN_DPL) );
 
   // If it didn't work, the features are not enabled
   if ( ! read_register(FEATURE) )
   {
     // So enable them and try again
     toggle_features();
-    write_register(FEATURE,read_register(FEATURE) | _BV(EN_DPL) );
+    write_register(FEATURE,read_shadow(FEATURE));
   }
 
-  IF_SERIAL_DEBUG(printf_P(PSTR("FEATURE=%i\r\n"),read_register(FEATURE)));
+  log_debug(RADIO,"FEATURE=%i",read_register(FEATURE));
 
   // Enable dynamic payload on all pipes
   //
   // Not sure the use case of only having dynamic payload on certain
   // pipes, so the library does not support it.
-  write_register(DYNPD,read_register(DYNPD) | _BV(DPL_P5) | _BV(DPL_P4) | _BV(DPL_P3) | _BV(DPL_P2) | _BV(DPL_P1) | _BV(DPL_P0));
+  update_register(DYNPD,read_shadow(DYNPD) | _BV(DPL_P5) | _BV(DPL_P4) | _BV(DPL_P3) | _BV(DPL_P2) | _BV(DPL_P1) | _BV(DPL_P0));
 
   dynamic_payloads_enabled = true;
 }
@@ -703,23 +1310,38 @@ void RF24::enableAckPayload(void)
   // enable ack payload and dynamic payload features
   //
 
-  write_register(FEATURE,read_register(FEATURE) | _BV(EN_DYN_ACK) | _BV(EN_ACK_PAY) | _BV(EN_DPL) );
+  update_register(FEATURE,read_shadow(FEATURE) | _BV(EN_DYN_ACK) | _BV(EN_ACK_PAY) | _BV(EN_DPL) );
 
   // If it didn't work, the features are not enabled
   if ( ! read_register(FEATURE) )
   {
     // So enable them and try again
     toggle_features();
-    write_register(FEATURE,read_register(FEATURE) | _BV(EN_DYN_ACK) | _BV(EN_ACK_PAY) | _BV(EN_DPL) );
+    write_register(FEATURE,read_shadow(FEATURE));
   }
 
-  IF_SERIAL_DEBUG(printf_P(PSTR("FEATURE=%i\r\n"),read_register(FEATURE)));
+  log_debug(RADIO,"FEATURE=%i",read_register(FEATURE));
 
   //
   // Enable dynamic payload on pipes 0 & 1
   //
 
-  write_register(DYNPD,read_register(DYNPD) | _BV(DPL_P1) | _BV(DPL_P0));
+  update_register(DYNPD,read_shadow(DYNPD) | _BV(DPL_P1) | _BV(DPL_P0));
+}
+
+/****************************************************************************/
+
+void RF24::enableDynamicAck(void)
+{
+  update_register(FEATURE,read_shadow(FEATURE) | _BV(EN_DYN_ACK) );
+
+  // If it didn't work, the features are not enabled
+  if ( ! read_register(FEATURE) )
+  {
+    // So enable them and try again
+    toggle_features();
+    write_register(FEATURE,read_shadow(FEATURE));
+  }
 }
 
 /****************************************************************************/
@@ -732,8 +1354,7 @@ void RF24::writeAckPayload(uint8_t pipe, const void* buf, uint8_t len)
   HP.spiTransfer( W_ACK_PAYLOAD | ( pipe & B111 ) );
   const uint8_t max_payload_size = 32;
   uint8_t data_len = MIN(len,max_payload_size);
-  while ( data_len-- )
-    HP.spiTransfer(*current++);
+  HP.spiWriteBuffer(current,data_len);
 
   HP.csn(HIGH);
 }
@@ -759,9 +1380,9 @@ bool RF24::isPVariant(void)
 void RF24::setAutoAck(bool enable)
 {
   if ( enable )
-    write_register(EN_AA, B111111);
+    update_register(EN_AA, B111111);
   else
-    write_register(EN_AA, 0);
+    update_register(EN_AA, 0);
 }
 
 /****************************************************************************/
@@ -770,7 +1391,7 @@ void RF24::setAutoAck( uint8_t pipe, bool enable )
 {
   if ( pipe <= 6 )
   {
-    uint8_t en_aa = read_register( EN_AA ) ;
+    uint8_t en_aa = read_shadow( EN_AA ) ;
     if( enable )
     {
       en_aa |= _BV(pipe) ;
@@ -779,7 +1400,7 @@ void RF24::setAutoAck( uint8_t pipe, bool enable )
     {
       en_aa &= ~_BV(pipe) ;
     }
-    write_register( EN_AA, en_aa ) ;
+    update_register( EN_AA, en_aa ) ;
   }
 }
 
@@ -799,9 +1420,56 @@ bool RF24::testRPD(void)
 
 /****************************************************************************/
 
+uint8_t RF24::surveyChannels(const uint8_t* channels, uint8_t count, uint8_t rounds, uint8_t* busy)
+{
+  uint8_t home = read_shadow(RF_CH);
+  uint8_t best = 0;
+  uint8_t fewest = 0xff;
+
+  update_register(CONFIG, read_shadow(CONFIG) | _BV(PWR_UP) | _BV(PRIM_RX));
+  wait_standby();
+
+  for ( uint8_t i = 0; i < count; i++ )
+    busy[i] = 0;
+
+  for ( uint8_t round = 0; round < rounds; round++ )
+  {
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+      update_register(RF_CH,channels[i]);
+
+      // RX settling, then RPD needs 40us of signal to latch
+      HP.ce(HIGH);
+      HP.delayMicroseconds(170);
+      HP.ce(LOW);
+
+      // CD on the nRF24L01 and RPD on the (+) share the register, both
+      // keep their value once CE is low
+      if ( testRPD() )
+        busy[i]++;
+    }
+  }
+
+  for ( uint8_t i = 0; i < count; i++ )
+  {
+    if ( busy[i] < fewest )
+    {
+      fewest = busy[i];
+      best = i;
+    }
+  }
+
+  update_register(RF_CH,home);
+  update_register(CONFIG, read_shadow(CONFIG) & ~_BV(PRIM_RX));
+
+  return channels[best];
+}
+
+/****************************************************************************/
+
 void RF24::setPALevel(rf24_pa_dbm_e level)
 {
-  uint8_t setup = read_register(RF_SETUP) ;
+  uint8_t setup = read_shadow(RF_SETUP) ;
   setup &= ~(_BV(RF_PWR_LOW) | _BV(RF_PWR_HIGH)) ;
 
   // switch uses RAM (evil!)
@@ -827,7 +1495,7 @@ void RF24::setPALevel(rf24_pa_dbm_e level)
     setup |= (_BV(RF_PWR_LOW) | _BV(RF_PWR_HIGH)) ;
   }
 
-  write_register( RF_SETUP, setup ) ;
+  update_register( RF_SETUP, setup ) ;
 }
 
 /****************************************************************************/
@@ -835,7 +1503,7 @@ void RF24::setPALevel(rf24_pa_dbm_e level)
 rf24_pa_dbm_e RF24::getPALevel(void)
 {
   rf24_pa_dbm_e result = RF24_PA_ERROR ;
-  uint8_t power = read_register(RF_SETUP) & (_BV(RF_PWR_LOW) | _BV(RF_PWR_HIGH)) ;
+  uint8_t power = read_shadow(RF_SETUP) & (_BV(RF_PWR_LOW) | _BV(RF_PWR_HIGH)) ;
 
   // switch uses RAM (evil!)
   if ( power == (_BV(RF_PWR_LOW) | _BV(RF_PWR_HIGH)) )
@@ -863,7 +1531,7 @@ rf24_pa_dbm_e RF24::getPALevel(void)
 bool RF24::setDataRate(rf24_datarate_e speed)
 {
   bool result = false;
-  uint8_t setup = read_register(RF_SETUP) ;
+  uint8_t setup = read_shadow(RF_SETUP) ;
 
   // HIGH and LOW '00' is 1Mbs - our default
   wide_band = false ;
@@ -890,16 +1558,18 @@ bool RF24::setDataRate(rf24_datarate_e speed)
       wide_band = false ;
     }
   }
-  write_register(RF_SETUP,setup);
+  update_register(RF_SETUP,setup);
 
-  // Verify our result
-  if ( read_register(RF_SETUP) == setup )
+  // Verify our result, a non-P variant refuses 250KBPS
+  uint8_t actual = read_register(RF_SETUP);
+  if ( actual == setup )
   {
     result = true;
   }
   else
   {
     wide_band = false;
+    shadow[shadow_index(RF_SETUP)] = actual;
   }
 
   return result;
@@ -910,7 +1580,7 @@ bool RF24::setDataRate(rf24_datarate_e speed)
 rf24_datarate_e RF24::getDataRate( void )
 {
   rf24_datarate_e result ;
-  uint8_t dr = read_register(RF_SETUP) & (_BV(RF_DR_LOW) | _BV(RF_DR_HIGH));
+  uint8_t dr = read_shadow(RF_SETUP) & (_BV(RF_DR_LOW) | _BV(RF_DR_HIGH));
   
   // switch uses RAM (evil!)
   // Order matters in our case below
@@ -936,7 +1606,7 @@ rf24_datarate_e RF24::getDataRate( void )
 
 void RF24::setCRCLength(rf24_crclength_e length)
 {
-  uint8_t config = read_register(CONFIG) & ~( _BV(CRCO) | _BV(EN_CRC)) ;
+  uint8_t config = read_shadow(CONFIG) & ~( _BV(CRCO) | _BV(EN_CRC)) ;
   
   // switch uses RAM (evil!)
   if ( length == RF24_CRC_DISABLED )
@@ -952,7 +1622,7 @@ void RF24::setCRCLength(rf24_crclength_e length)
     config |= _BV(EN_CRC);
     config |= _BV( CRCO );
   }
-  write_register( CONFIG, config ) ;
+  update_register( CONFIG, config ) ;
 }
 
 /****************************************************************************/
@@ -960,7 +1630,7 @@ void RF24::setCRCLength(rf24_crclength_e length)
 rf24_crclength_e RF24::getCRCLength(void)
 {
   rf24_crclength_e result = RF24_CRC_DISABLED;
-  uint8_t config = read_register(CONFIG) & ( _BV(CRCO) | _BV(EN_CRC)) ;
+  uint8_t config = read_shadow(CONFIG) & ( _BV(CRCO) | _BV(EN_CRC)) ;
 
   if ( config & _BV(EN_CRC ) )
   {
@@ -977,32 +1647,34 @@ rf24_crclength_e RF24::getCRCLength(void)
 
 void RF24::disableCRC( void )
 {
-  uint8_t disable = read_register(CONFIG) & ~_BV(EN_CRC) ;
-  write_register( CONFIG, disable ) ;
+  uint8_t disable = read_shadow(CONFIG) & ~_BV(EN_CRC) ;
+  update_register( CONFIG, disable ) ;
 }
 
 /****************************************************************************/
 
 void RF24::setRetries(uint8_t delay, uint8_t count)
 {
- write_register(SETUP_RETR,(delay&0xf)<<ARD | (count&0xf)<<ARC);
+  update_register(SETUP_RETR,(delay&0xf)<<ARD | (count&0xf)<<ARC);
 }
 
 /****************************************************************************/
 
 uint8_t RF24::getRetries( void )
 {
-  return read_register( SETUP_RETR ) ;
+  return read_shadow( SETUP_RETR ) ;
 }
 
 /****************************************************************************/
 
-uint16_t RF24::getMaxTimeout( void )
+uint32_t RF24::getMaxTimeout( void )
 {
   uint8_t retries = getRetries() ;
-  uint16_t to = ((250 + (250 * ((retries & 0xf0) >> 4))) * (retries & 0x0f)) ;
+  uint8_t address_width = ( read_shadow(SETUP_AW) & B11 ) + 2;
+  uint8_t payload = dynamic_payloads_enabled ? RF24_MAX_PAYLOAD : payload_size;
 
-  return to ;
+  return rf24_worst_latency_us(getDataRate(),address_width,getCRCLength(),payload,
+                               rf24_ard_us(retries >> ARD),retries & 0x0f);
 }
 
 // vim:ai:cin:sts=2 sw=2 ft=cpp
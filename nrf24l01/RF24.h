@@ -20,6 +20,7 @@
 //#define _BV(x)   (1<<(x))
 #define MAX(a,b) (a>b?a:b)
 #define MIN(a,b) (a<b?a:b)
+#define B11      0b11
 #define B111     0b111
 #define B1111    0b1111
 #define B0101    0b0101
@@ -27,6 +28,20 @@
 #define LOW      0
 #define HIGH     1
 
+#define RF24_SHADOW_SIZE 9 /**< Number of configuration registers kept in RAM */
+#define RF24_IMAGE_VERSION 1 /**< Layout of rf24_image_t, bump on any change */
+#define RF24_IMAGE_P_VARIANT 0x01 /**< rf24_image_t::flags */
+#define RF24_IMAGE_WIDE_BAND 0x02
+#define RF24_IMAGE_DYNAMIC   0x04
+
+#ifndef RF24_POWERUP_US
+/**
+ * Tpd2stby, PWR_UP to Standby-I.  1.5ms with the crystals of common
+ * modules, the datasheet allows up to 4.5ms for high inductance crystals.
+ */
+#define RF24_POWERUP_US 1500
+#endif
+
 /**
  * Power Amplifier level.
  *
@@ -48,6 +63,35 @@ typedef enum { RF24_1MBPS = 0, RF24_2MBPS, RF24_250KBPS } rf24_datarate_e;
  */
 typedef enum { RF24_CRC_DISABLED = 0, RF24_CRC_8, RF24_CRC_16 } rf24_crclength_e;
 
+/**
+ * Radio state as far as the driver drove it.
+ *
+ * For use with getState()
+ */
+typedef enum { RF24_POWER_DOWN = 0, RF24_STANDBY_I, RF24_TX, RF24_RX } rf24_state_e;
+
+/**
+ * Everything the radio was configured with, as kept in EEPROM.
+ *
+ * For use with getImage(), beginFromImage() and beginFromFlash(), see
+ * RF24Config.h for building one at compile time.
+ */
+typedef struct
+{
+  uint8_t version; /**< RF24_IMAGE_VERSION */
+  uint16_t key; /**< Caller's configuration id */
+  uint8_t shadow[RF24_SHADOW_SIZE]; /**< Configuration registers, powered down */
+  uint8_t rx_addr_p0[5];
+  uint8_t rx_addr_p1[5];
+  uint8_t rx_addr_lsb[4]; /**< RX_ADDR_P2 to RX_ADDR_P5 */
+  uint8_t tx_addr[5];
+  uint8_t rx_pw[6]; /**< RX_PW_P0 to RX_PW_P5 */
+  uint8_t payload_size;
+  uint8_t flags; /**< RF24_IMAGE_P_VARIANT, _WIDE_BAND and _DYNAMIC */
+  uint64_t pipe0_reading_address;
+  uint16_t crc; /**< CRC-16/CCITT over everything above */
+} rf24_image_t;
+
 /**
  * Driver for nRF24L01(+) 2.4GHz Wireless Transceiver
  */
@@ -62,6 +106,48 @@ private:
   bool dynamic_payloads_enabled; /**< Whether dynamic payloads are enabled. */ 
   uint8_t ack_payload_length; /**< Dynamic size of pending ack payload. */
   uint64_t pipe0_reading_address; /**< Last address set on pipe 0 for reading. */
+  volatile bool tx_pending; /**< Set by startWrite(), cleared by irq() or finishWrite(). */
+  uint8_t burst_count; /**< Number of payloads loaded by startBurst(). */
+  uint8_t burst_delivered; /**< Number of burst payloads acknowledged so far. */
+  uint8_t shadow[RF24_SHADOW_SIZE]; /**< RAM copy of the configuration registers. */
+  uint16_t spi_saved; /**< SPI transactions avoided thanks to the shadow. */
+  rf24_state_e state; /**< What the driver last told the radio to do. */
+  uint16_t state_since; /**< Platform tick of the last state change. */
+  uint16_t tx_ticks; /**< Platform ticks the last send spent in TX. */
+  uint16_t powered_at; /**< Platform tick PWR_UP was set. */
+  bool powering_up; /**< Oscillator may not have reached Standby-I yet. */
+
+  /**
+   * Position of a register in the shadow
+   *
+   * @param reg Which register. Use constants from nRF24L01.h
+   * @return Index into shadow, RF24_SHADOW_SIZE if the register is not mirrored
+   */
+  static uint8_t shadow_index(uint8_t reg);
+
+  /**
+   * Enter a new state and remember when
+   */
+  void set_state(rf24_state_e next);
+
+  /**
+   * Follow PWR_UP in a CONFIG value on its way to the chip
+   *
+   * @param config New CONFIG value
+   */
+  void track_config(uint8_t config);
+
+  /**
+   * Leave RX, set PWR_UP and clear PRIM_RX, ready for CE to start a send
+   */
+  void enter_tx(void);
+
+  /**
+   * Wait for whatever is left of Tpd2stby since PWR_UP was set
+   *
+   * Returns right away if the radio powered up long enough ago.
+   */
+  void wait_standby(void);
 
 protected:
 
@@ -102,6 +188,24 @@ protected:
    */
   uint8_t write_register(uint8_t reg, uint8_t value);
 
+  /**
+   * Write a single byte to a register, unless the shadow says it already
+   * holds that value
+   *
+   * @param reg Which register. Use constants from nRF24L01.h
+   * @param value The new value to write
+   */
+  void update_register(uint8_t reg, uint8_t value);
+
+  /**
+   * Read a single byte from the shadow, falls back to the chip for
+   * registers that are not mirrored
+   *
+   * @param reg Which register. Use constants from nRF24L01.h
+   * @return Last value written to register @p reg
+   */
+  uint8_t read_shadow(uint8_t reg);
+
   /**
    * Write the transmit payload
    *
@@ -117,6 +221,7 @@ protected:
    * Read the receive payload
    *
    * The size of data read is the fixed payload size, see getPayloadSize()
+   * With dynamic payloads, pass getDynamicPayloadSize() as @p len
    *
    * @param buf Where to put the data
    * @param len Maximum number of bytes to read
@@ -196,6 +301,13 @@ protected:
    * are enabled.  See the datasheet for details.
    */
   void toggle_features(void);
+
+  /**
+   * Stream a register image into the chip and verify it
+   *
+   * @return True if the chip holds the image afterwards
+   */
+  bool restore_image(const rf24_image_t* image);
   /**@}*/
 
 public:
@@ -220,6 +332,44 @@ public:
    */
   void begin(void);
 
+  /**
+   * Begin operation of the chip from an image saved by getImage()
+   *
+   * Replaces begin() and the rest of the configuration: the image is
+   * written back in one pass and read back to verify it.  There is no
+   * variant probe, and no 5ms settling delay unless the first verify
+   * fails, which it does while the chip is still in power on reset.
+   *
+   * @param image Image, typically read from EEPROM
+   * @param key Configuration id the image was saved with
+   * @return False if the image is invalid, stale or does not verify, call
+   * begin() and configure the radio as usual then.
+   */
+  bool beginFromImage(const rf24_image_t* image, uint16_t key);
+
+  /**
+   * Capture the radio configuration for beginFromImage()
+   *
+   * Call it once the radio is fully configured.  PWR_UP and PRIM_RX are
+   * left out, the image always restores into Power Down.
+   *
+   * @param[out] image Where to put the image
+   * @param key Configuration id, e.g. a hash of the build, so an image
+   * left by an older firmware is not restored
+   */
+  void getImage(rf24_image_t* image, uint16_t key);
+
+  /**
+   * Begin operation of the chip from an image in program memory
+   *
+   * Like beginFromImage(), for an image built by rf24_config_image(), see
+   * RF24Config.h.  It is trusted as it is, without key or CRC.
+   *
+   * @param image Image declared PLATFORM_FLASH
+   * @return False if the chip does not verify
+   */
+  bool beginFromFlash(const rf24_image_t* image);
+
   /**
    * Start listening on the pipes opened for reading.
    *
@@ -407,9 +557,10 @@ public:
    * Get Dynamic Payload Size
    *
    * For dynamic payloads, this pulls the size of the payload off
-   * the chip
+   * the chip.  A corrupt width (above 32) flushes the RX FIFO.
    *
-   * @return Payload length of last-received dynamic payload
+   * @return Payload length of last-received dynamic payload, 0 if it
+   * was corrupt
    */
   uint8_t getDynamicPayloadSize(void);
   
@@ -425,6 +576,15 @@ public:
    */
   void enableAckPayload(void);
 
+  /**
+   * Enable the W_TX_PAYLOAD_NO_ACK command
+   *
+   * Needed for write() with multicast set and for writeCopies(), the
+   * radio ignores a no-ack payload unless EN_DYN_ACK is set.
+   * enableAckPayload() sets it as well.
+   */
+  void enableDynamicAck(void);
+
   /**
    * Enable dynamically-sized payloads
    *
@@ -550,10 +710,38 @@ public:
   /**
    * Leave low-power mode - making radio more responsive
    *
+   * Does not wait for the oscillator.  The first write() or
+   * startListening() afterwards waits for whatever is left of
+   * RF24_POWERUP_US, so work done in between is not wasted.
+   *
    * To return to low power mode, call powerDown().
    */
   void powerUp(void) ;
 
+  /**
+   * Current radio state
+   *
+   * @return What the driver last told the radio to do
+   */
+  rf24_state_e getState(void);
+
+  /**
+   * Time spent in the current state
+   *
+   * @return Platform ticks (128us) since the last state change
+   */
+  uint16_t getStateTicks(void);
+
+  /**
+   * Duration of the last send
+   *
+   * From CE high to the end of the send, i.e. to the ack for a delivered
+   * payload, whatever write path sent it.
+   *
+   * @return Platform ticks (128us) the radio spent in TX
+   */
+  uint16_t getSendTicks(void);
+
   /**
    * Test whether there are bytes available to be read
    *
@@ -580,6 +768,132 @@ public:
    */
   void startWrite( const void* buf, uint8_t len, const bool multicast=false );
 
+  /**
+   * Non-blocking write with the payload upload in the background
+   *
+   * Like startWrite(), but the payload is clocked out by the SPI interrupt
+   * while the caller keeps working or sleeps.  CE goes high as soon as the
+   * upload finished and stays high until finishWrite().
+   *
+   * @param job Transaction to fill in, must stay valid until job->done
+   * @param buf Pointer to the data to be sent, must stay valid until job->done
+   * @param len Number of bytes to be sent
+   * @param multicast true or false. True, buffer will be multicast; ignoring retry/timeout
+   * @return False if the SPI queue was full and nothing was sent
+   */
+  bool startWriteQueued( spi_job_t* job, const void* buf, uint8_t len, const bool multicast=false );
+
+  /**
+   * Write a register in the background through the SPI queue
+   *
+   * The register shadow is updated right away for single byte writes.
+   *
+   * @param job Transaction to fill in, must stay valid until job->done
+   * @param reg Which register. Use constants from nRF24L01.h
+   * @param buf Where to get the data, must stay valid until job->done
+   * @param len How many bytes of data to transfer
+   * @return False if the SPI queue was full and nothing was written
+   */
+  bool queueRegister( spi_job_t* job, uint8_t reg, const uint8_t* buf, uint8_t len );
+
+  /**
+   * Configure the MCU to receive the IRQ line of the radio
+   *
+   * The radio pulls IRQ low on TX_DS, MAX_RT and RX_DR.  After this call
+   * the falling edge raises an external interrupt whose handler must call
+   * irq().
+   */
+  void enableIRQ(void);
+
+  /**
+   * Notify the driver that the radio asserted its IRQ line
+   *
+   * Call this from the external interrupt service routine.  It does not
+   * touch the SPI bus, so it is safe to call while the main code is
+   * in the middle of a transaction.
+   */
+  void irq(void);
+
+  /**
+   * Test whether the last startWrite() is still in flight
+   *
+   * @return True until the radio raised its IRQ line for the payload
+   */
+  bool isTxPending(void);
+
+  /**
+   * Complete a send started with startWrite()
+   *
+   * Call this after isTxPending() went false (or a timeout elapsed).  It
+   * reads and clears the status register and fetches the ack payload
+   * length, exactly like the tail of write().
+   *
+   * @return True if the payload was delivered successfully false if not
+   */
+  bool finishWrite(void);
+
+  /**
+   * Load up to three payloads into the TX FIFO and send them back to back
+   *
+   * All payloads go out on a single CE pulse: CE stays high until the FIFO
+   * is drained, so the radio pays the power-up and PLL settling only once.
+   * Like startWrite(), this returns immediately.  Call serviceBurst() each
+   * time the IRQ fires and finishBurst() once it returned true.
+   *
+   * @param bufs Pointers to the payloads, in transmit order
+   * @param lens Length of each payload
+   * @param count Number of payloads, max 3 (the depth of the TX FIFO)
+   */
+  void startBurst( const void* const* bufs, const uint8_t* lens, uint8_t count );
+
+  /**
+   * Account for the status change that raised the IRQ during a burst
+   *
+   * @return True when the burst is over: every payload was acknowledged
+   * or the radio gave up on one of them (MAX_RT)
+   */
+  bool serviceBurst(void);
+
+  /**
+   * End a burst started with startBurst()
+   *
+   * Drops CE, flushes payloads the radio gave up on so they can not shift
+   * into the next send, and clears the status register.
+   *
+   * @return Delivery result per payload, bit n set if payload n was acknowledged
+   */
+  uint8_t finishBurst(void);
+
+  /**
+   * Blocking burst write, see startBurst()
+   *
+   * @param bufs Pointers to the payloads, in transmit order
+   * @param lens Length of each payload
+   * @param count Number of payloads, max 3
+   * @return Delivery result per payload, bit n set if payload n was acknowledged
+   */
+  uint8_t writeBurst( const void* const* bufs, const uint8_t* lens, uint8_t count );
+
+  /**
+   * Send the same payload several times without asking for an ack
+   *
+   * Each copy goes out with W_TX_PAYLOAD_NO_ACK on its own CE pulse, and
+   * the radio goes back to Standby-I for @p gap_us in between, so a burst
+   * of interference is less likely to take every copy.  There is no retry
+   * and no receive window: the call takes exactly @p copies times the
+   * settling and the airtime plus the gaps, see rf24_copies_us().
+   *
+   * The receiver sees every copy that got through, the payload must carry
+   * a sequence number to drop the repeats.  Enables EN_DYN_ACK if needed.
+   *
+   * @param buf Pointer to the data to be sent
+   * @param len Number of bytes to be sent
+   * @param copies How many times to send it
+   * @param gap_us Pause between two copies
+   * @return Number of copies the radio transmitted, not how many arrived
+   */
+  uint8_t writeCopies( const void* buf, uint8_t len, uint8_t copies, uint16_t gap_us );
+
   /**
    * Write an ack payload for the specified pipe
    *
@@ -647,14 +961,93 @@ public:
    */
   bool testRPD(void) ;
 
+  /**
+   * Find the quietest of a set of channels
+   *
+   * Listens on every channel in turn for 170us (RX settling plus the RPD
+   * measurement) and counts how often RPD/CD reported a signal.  The list
+   * is swept @p rounds times rather than sampling each channel in one go,
+   * so a burst of traffic does not condemn a single channel.  About 185us
+   * per sample: 6 channels over 16 rounds take 18ms.
+   *
+   * The radio must be powered up and not listening.  It is left in
+   * Standby-I on its original channel.
+   *
+   * @param channels Channels to survey, the preferred one first
+   * @param count Number of channels
+   * @param rounds Samples per channel, at most 255
+   * @param[out] busy Busy samples per channel, @p count entries
+   * @return The channel with the fewest busy samples, the earliest in
+   * @p channels on a tie
+   */
+  uint8_t surveyChannels(const uint8_t* channels, uint8_t count, uint8_t rounds, uint8_t* busy);
+
 
   /**
    * Calculate the maximum timeout in us based on current hardware
    * configuration.
    *
+   * Airtime of the longest payload plus the retry delay for every
+   * attempt, see rf24_worst_latency_us().
+   *
    * @return us of maximum timeout; accounting for retries
    */
-  uint16_t getMaxTimeout(void) ;
+  uint32_t getMaxTimeout(void) ;
+
+  /**
+   * Read the transmit observe register
+   *
+   * @return OBSERVE_TX, PLOS_CNT in the high nibble and ARC_CNT of the
+   * last payload in the low nibble
+   */
+  uint8_t getObserveTx(void);
+
+#if RF24_INSTRUMENT
+  /**
+   * Print the instrumentation counters to stdout
+   *
+   * Only available when built with RF24_INSTRUMENT=1.  Durations are
+   * Timer1 ticks of 128us.
+   */
+  void printStats(void);
+#endif
+
+  /**
+   * Reload the register shadow from the chip
+   *
+   * begin() does this once.  Call it again if something else configured
+   * the radio behind the driver's back.
+   */
+  void syncRegisters(void);
+
+  /**
+   * Compare the chip against the register shadow
+   *
+   * Costs one read per mirrored register.  A mismatch means the radio lost
+   * power (or was reset) since it was configured.
+   *
+   * @return True if every mirrored register holds the expected value
+   */
+  bool verifyRegisters(void);
+
+  /**
+   * Write the whole register shadow back to the chip, e.g. after power loss
+   *
+   * Pipe addresses are not part of the shadow, reopen the pipes after a
+   * restore.
+   *
+   * @return True if the chip verified afterwards
+   */
+  bool restoreRegisters(void);
+
+  /**
+   * Number of SPI transactions the register shadow avoided so far
+   *
+   * Counts both skipped redundant writes and reads served from RAM.
+   *
+   * @return Saved transactions, wraps at 65535
+   */
+  uint16_t getSavedTransactions(void);
 
   /**@}*/
 };
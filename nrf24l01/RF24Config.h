@@ -0,0 +1,141 @@
+/**
+ * @file RF24Config.h
+ *
+ * Compile time radio configuration.
+ *
+ * A node's radio setup written down as an rf24_config_t constant becomes
+ * the register image RF24::beginFromFlash() streams into the chip, so no
+ * setter runs and no 64 bit address is shifted on the node.  The result is
+ * the same image begin() followed by the setters and openWritingPipe() /
+ * openReadingPipe(1) leaves, for the chip variant RF24_P_VARIANT names.
+ *
+ * @code
+ * constexpr rf24_config_t radio_config = { RF24_250KBPS, RF24_CRC_16, RF24_PA_MAX,
+ *     110, 5, 750, 15, 32, true, 8, 0xF0F0F0F0E1LL, 0xF0F0F0F0D2LL };
+ * RF24_CHECK_CONFIG(radio_config);
+ * const rf24_image_t radio_image PLATFORM_FLASH = rf24_config_image(radio_config);
+ * @endcode
+ */
+
+#ifndef __RF24CONFIG_H__
+#define __RF24CONFIG_H__
+
+#include "RF24Timing.h"
+
+#define RF24_MAX_CHANNEL 125 /**< 2.525GHz, the top of the band */
+
+// Build with -DRF24_P_VARIANT=0 for an nRF24L01 without the plus.  Its
+// RF_SETUP keeps LNA_HCURR set and it has no 250KBPS, which begin() finds
+// out at run time and a compile time image has to be told.
+#ifndef RF24_P_VARIANT
+#define RF24_P_VARIANT 1
+#endif
+
+/**
+ * What a node sets up, in the order of the driver calls it replaces
+ */
+struct rf24_config_t
+{
+  rf24_datarate_e rate;
+  rf24_crclength_e crc;
+  rf24_pa_dbm_e pa_level;
+  uint8_t channel;
+  uint8_t address_width; /**< 3-5 bytes */
+  uint16_t ard_us; /**< Retry delay, a multiple of 250us */
+  uint8_t retries; /**< ARC, 0-15 */
+  uint8_t payload_size; /**< Fixed payload width, RX_PW of the open pipes */
+  bool dynamic_payloads; /**< As enableDynamicPayloads() */
+  uint8_t ack_payload; /**< Longest ack payload, 0 leaves enableAckPayload() out */
+  uint64_t tx_address; /**< openWritingPipe(), also RX_ADDR_P0 for the ack */
+  uint64_t rx_address; /**< openReadingPipe(1) */
+
+  constexpr uint8_t config_reg() const
+  {
+    return crc == RF24_CRC_DISABLED ? 0
+      : crc == RF24_CRC_8 ? _BV(EN_CRC) : _BV(EN_CRC) | _BV(CRCO);
+  }
+
+  constexpr uint8_t setup_retr_reg() const
+  {
+    return ( rf24_ard_code(ard_us) << ARD ) | ( retries << ARC );
+  }
+
+  /** LNA_HCURR is what begin() leaves on a non-P part, its reset value */
+  constexpr uint8_t rf_setup_reg(bool p_variant) const
+  {
+    return ( rate == RF24_250KBPS ? _BV(RF_DR_LOW) : rate == RF24_2MBPS ? _BV(RF_DR_HIGH) : 0 )
+      | ( ( pa_level > RF24_PA_MAX ? RF24_PA_MAX : pa_level ) << RF_PWR_LOW )
+      | ( p_variant ? 0 : _BV(LNA_HCURR) );
+  }
+
+  constexpr uint8_t feature_reg() const
+  {
+    return ( dynamic_payloads ? _BV(EN_DPL) : 0 )
+      | ( ack_payload ? _BV(EN_DYN_ACK) | _BV(EN_ACK_PAY) | _BV(EN_DPL) : 0 );
+  }
+
+  constexpr uint8_t dynpd_reg() const
+  {
+    return ( dynamic_payloads ? 0x3f : 0 ) | ( ack_payload ? _BV(DPL_P1) | _BV(DPL_P0) : 0 );
+  }
+
+  /** Byte @p i of @p address, LSB first like the chip expects it */
+  static constexpr uint8_t address_byte(uint64_t address, uint8_t i)
+  {
+    return address >> ( 8 * i );
+  }
+
+  /** Whether @p address fits into the address width */
+  constexpr bool address_fits(uint64_t address) const
+  {
+    return address_width >= 3 && address_width <= 5 && ( address >> ( 8 * address_width ) ) == 0;
+  }
+};
+
+/**
+ * Register image of a configuration, for RF24::beginFromFlash()
+ *
+ * Pipes 2-5 keep their reset addresses and stay closed.
+ */
+constexpr rf24_image_t rf24_config_image(const rf24_config_t& c, bool p_variant = RF24_P_VARIANT)
+{
+  return rf24_image_t {
+    RF24_IMAGE_VERSION, 0,
+    { c.config_reg(), 0x3f, _BV(ERX_P1) | _BV(ERX_P0), (uint8_t) ( c.address_width - 2 ),
+      c.setup_retr_reg(), c.channel, c.rf_setup_reg(p_variant), c.feature_reg(), c.dynpd_reg() },
+    { rf24_config_t::address_byte(c.tx_address,0), rf24_config_t::address_byte(c.tx_address,1),
+      rf24_config_t::address_byte(c.tx_address,2), rf24_config_t::address_byte(c.tx_address,3),
+      rf24_config_t::address_byte(c.tx_address,4) },
+    { rf24_config_t::address_byte(c.rx_address,0), rf24_config_t::address_byte(c.rx_address,1),
+      rf24_config_t::address_byte(c.rx_address,2), rf24_config_t::address_byte(c.rx_address,3),
+      rf24_config_t::address_byte(c.rx_address,4) },
+    { 0xc3, 0xc4, 0xc5, 0xc6 },
+    { rf24_config_t::address_byte(c.tx_address,0), rf24_config_t::address_byte(c.tx_address,1),
+      rf24_config_t::address_byte(c.tx_address,2), rf24_config_t::address_byte(c.tx_address,3),
+      rf24_config_t::address_byte(c.tx_address,4) },
+    { c.payload_size, c.payload_size, 0, 0, 0, 0 },
+    c.payload_size,
+    (uint8_t) ( ( p_variant ? RF24_IMAGE_P_VARIANT : 0 ) | ( c.rate == RF24_2MBPS ? RF24_IMAGE_WIDE_BAND : 0 )
+                | ( c.dynamic_payloads ? RF24_IMAGE_DYNAMIC : 0 ) ),
+    0,
+    0
+  };
+}
+
+/**
+ * Reject a configuration the chip would not run as written
+ */
+#define RF24_CHECK_CONFIG(c) \
+  static_assert((c).channel <= RF24_MAX_CHANNEL, #c ": channel above 125"); \
+  static_assert((c).payload_size >= 1 && (c).payload_size <= RF24_MAX_PAYLOAD, #c ": payload size not 1-32"); \
+  static_assert((c).ack_payload <= RF24_MAX_PAYLOAD, #c ": ack payload above 32 bytes"); \
+  static_assert((c).address_fits((c).tx_address) && (c).address_fits((c).rx_address), \
+                #c ": address width not 3-5 or an address does not fit"); \
+  static_assert((c).retries <= 15, #c ": more than 15 retries"); \
+  static_assert(rf24_ard_us(rf24_ard_code((c).ard_us)) == (c).ard_us, #c ": retry delay not a multiple of 250us"); \
+  static_assert(rf24_ard_ok((c).rate,(c).ard_us,(c).ack_payload), #c ": retry delay too short for the ack"); \
+  static_assert((c).pa_level <= RF24_PA_MAX, #c ": no such PA level"); \
+  static_assert(RF24_P_VARIANT || (c).rate != RF24_250KBPS, #c ": 250KBPS needs an nRF24L01+")
+
+#endif // __RF24CONFIG_H__
+// vim:ai:cin:sts=2 sw=2 ft=cpp
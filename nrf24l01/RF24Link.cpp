@@ -0,0 +1,136 @@
+/**
+ * @file RF24Link.cpp
+ *
+ * Adaptive link control, see RF24Link.h
+ */
+
+#include "nRF24L01.h"
+#include "RF24Link.h"
+#include "RF24Timing.h"
+
+/****************************************************************************/
+
+RF24Link::RF24Link(RF24& _radio):
+  radio(_radio),
+  pa(RF24_PA_MAX),
+  ard(0),
+  ard_min(0),
+  clean(0),
+  probation(0),
+  hold(0),
+  backoff(0),
+  arc_avg(0)
+{
+}
+
+/****************************************************************************/
+
+void RF24Link::begin(uint8_t ack_payload_len)
+{
+  ard_min = rf24_ard_code(rf24_min_ard_us(radio.getDataRate(),ack_payload_len));
+  ard = ard_min;
+  pa = RF24_PA_MAX;
+  clean = 0;
+  probation = 0;
+  hold = 0;
+  backoff = 0;
+  arc_avg = 0;
+
+  apply();
+}
+
+/****************************************************************************/
+
+void RF24Link::apply(void)
+{
+  radio.setPALevel(static_cast<rf24_pa_dbm_e>(pa));
+  radio.setRetries(ard,RF24_LINK_ARC);
+}
+
+/****************************************************************************/
+
+void RF24Link::step_up(void)
+{
+  if ( pa < RF24_PA_MAX )
+    pa++;
+  else if ( ard < 15 )
+    ard = MIN(ard * 2 + 1,15);
+
+  clean = 0;
+  probation = 0;
+  arc_avg = 0;
+  hold = RF24_LINK_HOLD_SENDS << backoff;
+  if ( backoff < RF24_LINK_MAX_BACKOFF )
+    backoff++;
+}
+
+/****************************************************************************/
+
+void RF24Link::update(bool delivered)
+{
+  uint8_t arc = delivered ? ( radio.getObserveTx() >> ARC_CNT ) & B1111 : RF24_LINK_ARC;
+
+  // arc_avg += ( arc - arc_avg ) / 16 in 1/16 steps, rounding the decay
+  // up so that a single old retry does not linger forever
+  arc_avg = arc_avg - ( ( arc_avg + 15 ) >> 4 ) + arc;
+
+  if ( ! delivered )
+  {
+    // A lost payload costs more than any PA level saves
+    pa = RF24_PA_MAX;
+    step_up();
+  }
+  else if ( arc >= RF24_LINK_RAISE_ARC || arc_avg > RF24_LINK_RAISE_AVG || ( arc && probation ) )
+  {
+    step_up();
+  }
+  else if ( arc )
+  {
+    clean = 0;
+  }
+  else if ( ++clean >= RF24_LINK_CLEAN_SENDS )
+  {
+    clean = 0;
+    if ( ard > ard_min )
+    {
+      ard = MAX(ard >> 1,ard_min);
+    }
+    else if ( ! hold && pa > RF24_PA_MIN )
+    {
+      pa--;
+      probation = RF24_LINK_CLEAN_SENDS;
+    }
+  }
+
+  if ( hold )
+    hold--;
+
+  // A step down that survived its probation is a good one
+  if ( probation && ! --probation )
+    backoff = 0;
+
+  apply();
+}
+
+/****************************************************************************/
+
+rf24_pa_dbm_e RF24Link::getPALevel(void)
+{
+  return static_cast<rf24_pa_dbm_e>(pa);
+}
+
+/****************************************************************************/
+
+uint8_t RF24Link::getRetryDelay(void)
+{
+  return ard;
+}
+
+/****************************************************************************/
+
+uint8_t RF24Link::getAverageRetries(void)
+{
+  return arc_avg;
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -0,0 +1,107 @@
+/**
+ * @file RF24Link.h
+ *
+ * Adaptive link control for RF24: PA level and retry delay from the
+ * OBSERVE_TX feedback of every send
+ */
+
+#ifndef __RF24LINK_H__
+#define __RF24LINK_H__
+
+#include "RF24.h"
+
+#define RF24_LINK_CLEAN_SENDS 8 /**< Sends without a retry before stepping down */
+#define RF24_LINK_RAISE_ARC   3 /**< Retries on one send that step back up */
+#define RF24_LINK_RAISE_AVG   3 /**< Average retries per send that step back up, in 1/16 */
+#define RF24_LINK_HOLD_SENDS 32 /**< Sends to stay put after stepping back up, doubles on each revert */
+#define RF24_LINK_MAX_BACKOFF 3 /**< Hold doublings at most */
+#define RF24_LINK_ARC        15 /**< Retry count, kept at the maximum */
+
+/**
+ * Adaptive link controller
+ *
+ * Every send reports its outcome to update().  A run of sends that need
+ * no retry first shortens the retry delay, then steps the PA down one
+ * level.  Retries climbing, on one send or on average, step the PA back
+ * up (the retry delay once the PA is at maximum), and a lost payload goes
+ * straight back to full power.  A retry costs about as much as a whole
+ * send, more than a PA step saves, so the average may only reach 3/16 of
+ * a retry per send.  For RF24_LINK_CLEAN_SENDS after a step down any retry
+ * reverts it.  After stepping up the controller holds before trying lower
+ * again, twice as long every time a step down had to be reverted.
+ *
+ * The data rate is left alone: the gateway listens at one rate only, so
+ * the node can not change it on its own.
+ */
+
+class RF24Link
+{
+private:
+  RF24& radio;
+  uint8_t pa; /**< Current rf24_pa_dbm_e level */
+  uint8_t ard; /**< Current auto retransmit delay, in 250us steps minus one */
+  uint8_t ard_min; /**< Shortest delay that still fits the ack at the data rate */
+  uint8_t clean; /**< Sends in a row that needed no retry */
+  uint8_t probation; /**< Sends left in which a retry reverts the last step down */
+  uint16_t hold; /**< Sends left before stepping down is allowed again */
+  uint8_t backoff; /**< Step downs reverted in a row */
+  uint8_t arc_avg; /**< Moving average of ARC_CNT, 4 fractional bits */
+
+  /**
+   * Write the current levels to the radio, the register shadow makes
+   * unchanged ones free
+   */
+  void apply(void);
+
+  /**
+   * Power up a level, or lengthen the retry delay once at the maximum
+   */
+  void step_up(void);
+
+public:
+
+  /**
+   * Constructor
+   *
+   * @param _radio The radio to control
+   */
+  RF24Link(RF24& _radio);
+
+  /**
+   * Start from full power and the shortest retry delay
+   *
+   * Call after the radio is configured, it picks the minimum retry delay
+   * for the data rate then in use.
+   *
+   * @param ack_payload_len Longest ack payload the peer may send, 0 for none
+   */
+  void begin(uint8_t ack_payload_len = 0);
+
+  /**
+   * Feed the outcome of a send
+   *
+   * Call right after finishWrite() or finishBurst(), before anything
+   * else reaches the radio, so OBSERVE_TX still belongs to that send.
+   *
+   * @param delivered Whether the payload was acknowledged
+   */
+  void update(bool delivered);
+
+  /**
+   * @return PA level currently in use
+   */
+  rf24_pa_dbm_e getPALevel(void);
+
+  /**
+   * @return Auto retransmit delay setting, see RF24::setRetries()
+   */
+  uint8_t getRetryDelay(void);
+
+  /**
+   * @return Moving average of retries per send, 4 fractional bits
+   */
+  uint8_t getAverageRetries(void);
+};
+
+#endif // __RF24LINK_H__
+// vim:ai:cin:sts=2 sw=2 ft=cpp
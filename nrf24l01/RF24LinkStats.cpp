@@ -0,0 +1,162 @@
+/**
+ * @file RF24LinkStats.cpp
+ *
+ * Link quality statistics, see RF24LinkStats.h
+ */
+
+#include <string.h>
+
+#include "nRF24L01.h"
+#include "RF24LinkStats.h"
+
+// Upper ARC_CNT of each retry bin, the last one also takes lost sends
+static const uint8_t arc_bin_max[RF24_LINK_STATS_BINS - 1] = { 0, 1, 2, 5, 10 };
+
+/****************************************************************************/
+
+RF24LinkStats::RF24LinkStats(RF24& _radio):
+  radio(_radio)
+{
+  begin();
+}
+
+/****************************************************************************/
+
+void RF24LinkStats::begin(void)
+{
+  memset(arc_hist,0,sizeof arc_hist);
+  memset(ack_hist,0,sizeof ack_hist);
+  fast = 0xffff;
+  slow = 0xffff;
+  sends = 0;
+  fails = 0;
+}
+
+/****************************************************************************/
+
+void RF24LinkStats::count(uint8_t* hist, uint8_t bin)
+{
+  if ( hist[bin] == 0xff )
+    for ( uint8_t i = 0; i < RF24_LINK_STATS_BINS; i++ )
+      hist[i] >>= 1;
+
+  hist[bin]++;
+}
+
+/****************************************************************************/
+
+void RF24LinkStats::update(bool delivered)
+{
+  uint8_t bin = 0;
+  uint16_t sample = 0;
+
+  if ( delivered )
+  {
+    uint8_t arc = ( radio.getObserveTx() >> ARC_CNT ) & B1111;
+    sample = 0xffff / ( arc + 1 );
+    while ( bin < RF24_LINK_STATS_BINS - 1 && arc > arc_bin_max[bin] )
+      bin++;
+    count(arc_hist,bin);
+
+    // Doubling from 1ms, in platform ticks
+    uint32_t us = (uint32_t) radio.getSendTicks() * PLATFORM_TICK_US;
+    uint32_t limit = 1000;
+    for ( bin = 0; bin < RF24_LINK_STATS_BINS - 1 && us >= limit; bin++ )
+      limit <<= 1;
+    count(ack_hist,bin);
+  }
+  else
+  {
+    count(arc_hist,RF24_LINK_STATS_BINS - 1);
+    if ( fails < 0xff )
+      fails++;
+  }
+
+  // avg += ( sample - avg ) / 2^n, with the share of attempts that got
+  // through as the sample: retries show up long before sends fail
+  fast = fast - ( fast >> RF24_LINK_STATS_FAST ) + ( sample >> RF24_LINK_STATS_FAST );
+  slow = slow - ( slow >> RF24_LINK_STATS_SLOW ) + ( sample >> RF24_LINK_STATS_SLOW );
+
+  if ( sends < 0xffff )
+    sends++;
+}
+
+/****************************************************************************/
+
+uint8_t RF24LinkStats::getFastSuccess(void)
+{
+  return fast >> 8;
+}
+
+/****************************************************************************/
+
+uint8_t RF24LinkStats::getSlowSuccess(void)
+{
+  return slow >> 8;
+}
+
+/****************************************************************************/
+
+bool RF24LinkStats::isDegrading(void)
+{
+  return getFastSuccess() + RF24_LINK_STATS_MARGIN < getSlowSuccess();
+}
+
+/****************************************************************************/
+
+void RF24LinkStats::pack(const uint8_t* hist, uint8_t* buf)
+{
+  uint16_t total = 0;
+  for ( uint8_t i = 0; i < RF24_LINK_STATS_BINS; i++ )
+    total += hist[i];
+
+  for ( uint8_t i = 0; i < RF24_LINK_STATS_BINS; i++ )
+  {
+    uint8_t share = total ? ( hist[i] * 15U + total / 2 ) / total : 0;
+    if ( i & 1 )
+      buf[i / 2] |= share << 4;
+    else
+      buf[i / 2] = share;
+  }
+}
+
+/****************************************************************************/
+
+uint8_t RF24LinkStats::getSummary(uint8_t* buf)
+{
+  buf[0] = getFastSuccess();
+  buf[1] = getSlowSuccess();
+  pack(arc_hist,buf + 2);
+  pack(ack_hist,buf + 5);
+  buf[8] = sends;
+  buf[9] = sends >> 8;
+  buf[10] = fails;
+  buf[11] = ( ( radio.getObserveTx() >> PLOS_CNT ) & B1111 ) | ( radio.getPALevel() << 4 );
+
+  return RF24_LINK_STATS_SUMMARY;
+}
+
+/****************************************************************************/
+
+void RF24LinkStats::clearPeriod(void)
+{
+  sends = 0;
+  fails = 0;
+}
+
+/****************************************************************************/
+
+void RF24LinkStats::print(void)
+{
+  printf_P(PSTR("Success\t\t = %u/255 fast, %u/255 slow\r\n"),getFastSuccess(),getSlowSuccess());
+  printf_P(PSTR("Sends/fails\t = %u/%u\r\n"),sends,fails);
+  printf_P(PSTR("ARC 0/1/2/5/10/+\t ="));
+  for ( uint8_t i = 0; i < RF24_LINK_STATS_BINS; i++ )
+    printf_P(PSTR(" %u"),arc_hist[i]);
+  printf_P(PSTR("\r\nAck ms 1/2/4/8/16/+ ="));
+  for ( uint8_t i = 0; i < RF24_LINK_STATS_BINS; i++ )
+    printf_P(PSTR(" %u"),ack_hist[i]);
+  printf_P(PSTR("\r\n"));
+}
+
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -0,0 +1,125 @@
+/**
+ * @file RF24LinkStats.h
+ *
+ * Link quality statistics for RF24: retry and time to ack histograms and
+ * success rates from the outcome of every send
+ */
+
+#ifndef __RF24LINKSTATS_H__
+#define __RF24LINKSTATS_H__
+
+#include "RF24.h"
+
+#define RF24_LINK_STATS_BINS     6 /**< Bins per histogram */
+#define RF24_LINK_STATS_FAST     3 /**< Fast success average weighs a send 1/8 */
+#define RF24_LINK_STATS_SLOW     6 /**< Slow success average weighs a send 1/64 */
+#define RF24_LINK_STATS_MARGIN  32 /**< Fast below slow by this much, out of 255, is degrading */
+#define RF24_LINK_STATS_SUMMARY 12 /**< Bytes written by getSummary() */
+
+/**
+ * Link quality statistics
+ *
+ * Every send reports its outcome to update(), which files it into two
+ * rolling histograms, retries (ARC_CNT 0, 1, 2, 3-5, 6-10, 11-15 or
+ * lost) and time to ack (under 1, 2, 4, 8, 16ms and above), and into a
+ * fast and a slow moving average of the success rate.  The rate is that
+ * of attempts, 1/(ARC_CNT+1) for a delivered send and 0 for a lost one:
+ * with 15 retries sends rarely fail, retries climb first.  A histogram bin
+ * that fills up halves the whole histogram, so old sends fade out
+ * without a window to keep.  21 bytes of RAM in all.
+ *
+ * getSummary() packs it all into RF24_LINK_STATS_SUMMARY bytes for an
+ * uplink frame, little endian:
+ *
+ *   0      fast success average, 255 = every attempt acknowledged
+ *   1      slow success average
+ *   2-4    retry histogram, 6 nibbles, low nibble first, share of each bin in 1/15
+ *   5-7    time to ack histogram, same
+ *   8-9    sends since clearPeriod()
+ *   10     failed sends since clearPeriod(), saturating
+ *   11     PLOS_CNT | PA level << 4
+ */
+
+class RF24LinkStats
+{
+private:
+  RF24& radio;
+  uint8_t arc_hist[RF24_LINK_STATS_BINS]; /**< Sends by retries needed */
+  uint8_t ack_hist[RF24_LINK_STATS_BINS]; /**< Delivered sends by time to ack */
+  uint16_t fast; /**< Success average, 0xffff = all first attempts delivered */
+  uint16_t slow; /**< Same, over about eight times as many sends */
+  uint16_t sends; /**< Sends since clearPeriod() */
+  uint8_t fails; /**< Failed sends since clearPeriod() */
+
+  /**
+   * Count a send in a histogram, halving it first if the bin is full
+   */
+  static void count(uint8_t* hist, uint8_t bin);
+
+  /**
+   * Pack a histogram into three bytes of nibbles
+   */
+  static void pack(const uint8_t* hist, uint8_t* buf);
+
+public:
+
+  /**
+   * Constructor
+   *
+   * @param _radio The radio to watch
+   */
+  RF24LinkStats(RF24& _radio);
+
+  /**
+   * Forget everything, the success averages start from a good link
+   */
+  void begin(void);
+
+  /**
+   * Feed the outcome of a send
+   *
+   * Call right after finishWrite() or finishBurst(), before anything
+   * else reaches the radio, so OBSERVE_TX still belongs to that send.
+   *
+   * @param delivered Whether the payload was acknowledged
+   */
+  void update(bool delivered);
+
+  /**
+   * @return Attempt success rate over the last few sends, 255 = no retries
+   */
+  uint8_t getFastSuccess(void);
+
+  /**
+   * @return Attempt success rate over the last hundred or so sends
+   */
+  uint8_t getSlowSuccess(void);
+
+  /**
+   * Whether recent sends do markedly worse than the longer run
+   *
+   * @return True while the fast average is RF24_LINK_STATS_MARGIN below the slow one
+   */
+  bool isDegrading(void);
+
+  /**
+   * Pack the statistics for an uplink frame, see the layout above
+   *
+   * @param buf Room for RF24_LINK_STATS_SUMMARY bytes
+   * @return RF24_LINK_STATS_SUMMARY
+   */
+  uint8_t getSummary(uint8_t* buf);
+
+  /**
+   * Restart the send and failure counts, once a summary got through
+   */
+  void clearPeriod(void);
+
+  /**
+   * Print the statistics to the console
+   */
+  void print(void);
+};
+
+#endif // __RF24LINKSTATS_H__
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -0,0 +1,190 @@
+/**
+ * @file RF24Timing.h
+ *
+ * Compile time model of Enhanced ShockBurst timing and charge.
+ *
+ * All functions are constexpr, so a configuration written down as
+ * constants is checked by static_assert before it ever reaches a node,
+ * and the same functions size timeouts from the registers at run time.
+ *
+ * Figures from the nRF24L01+ product specification: 130us Standby-I to
+ * TX/RX settling, 9 bit packet control field, 11.3mA TX at 0dBm down to
+ * 7.0mA at -18dBm, 12.6-13.5mA RX.
+ */
+
+#ifndef __RF24TIMING_H__
+#define __RF24TIMING_H__
+
+#include "RF24.h"
+
+#if __cplusplus < 201103L
+#error "RF24Timing.h needs C++11, build with -std=gnu++11"
+#endif
+
+#define RF24_SETTLE_US 130 /**< Standby-I to TX or RX */
+#define RF24_ARD_STEP_US 250 /**< ARD resolution */
+#define RF24_ARD_MAX_US 4000
+#define RF24_MAX_PAYLOAD 32
+
+/**
+ * Bytes before the payload's address: preamble, 2 at 2MBPS
+ */
+constexpr uint8_t rf24_preamble_bytes(rf24_datarate_e rate)
+{
+  return rate == RF24_2MBPS ? 2 : 1;
+}
+
+/**
+ * Time on air of one ESB packet
+ *
+ * @param rate Data rate
+ * @param address_width Address bytes, 3-5
+ * @param crc CRC setting, its value is the number of CRC bytes
+ * @param payload Payload bytes, 0 for a plain ack
+ * @return Microseconds, rounded up
+ */
+constexpr uint16_t rf24_airtime_us(rf24_datarate_e rate, uint8_t address_width,
+                                   rf24_crclength_e crc, uint8_t payload)
+{
+  return rate == RF24_250KBPS
+    ? ( 8 * ( rf24_preamble_bytes(rate) + address_width + payload + crc ) + 9 ) * 4
+    : rate == RF24_1MBPS
+      ? ( 8 * ( rf24_preamble_bytes(rate) + address_width + payload + crc ) + 9 )
+      : ( 8 * ( rf24_preamble_bytes(rate) + address_width + payload + crc ) + 9 + 1 ) / 2;
+}
+
+/**
+ * Shortest ARD that still waits for the ack
+ *
+ * The datasheet rule: 500us at 250KBPS plus 250us per 8 bytes of ack
+ * payload, 500us at 1MBPS above 5 and at 2MBPS above 15 bytes of ack
+ * payload, 250us otherwise.
+ *
+ * @param rate Data rate
+ * @param ack_payload Longest ack payload expected, 0 for none
+ * @return Microseconds, a multiple of 250
+ */
+constexpr uint16_t rf24_min_ard_us(rf24_datarate_e rate, uint8_t ack_payload)
+{
+  return rate == RF24_250KBPS
+    ? 500 + RF24_ARD_STEP_US * ( ( ack_payload + 7 ) / 8 )
+    : ack_payload > ( rate == RF24_1MBPS ? 5 : 15 ) ? 500 : 250;
+}
+
+/**
+ * ARD register value for a delay, rounded up
+ *
+ * @return 0-15, the ARD nibble of SETUP_RETR
+ */
+constexpr uint8_t rf24_ard_code(uint16_t ard_us)
+{
+  return ard_us <= RF24_ARD_STEP_US ? 0 : ( ard_us + RF24_ARD_STEP_US - 1 ) / RF24_ARD_STEP_US - 1;
+}
+
+/**
+ * Delay of an ARD register value
+ */
+constexpr uint16_t rf24_ard_us(uint8_t ard_code)
+{
+  return RF24_ARD_STEP_US * ( ard_code + 1 );
+}
+
+/**
+ * Whether an ARD leaves room for the settling and the ack
+ *
+ * @return True if @p ard_us is valid for the rate and ack payload
+ */
+constexpr bool rf24_ard_ok(rf24_datarate_e rate, uint16_t ard_us, uint8_t ack_payload)
+{
+  return ard_us <= RF24_ARD_MAX_US && ard_us >= rf24_min_ard_us(rate,ack_payload)
+    && ard_us >= RF24_SETTLE_US + rf24_airtime_us(rate,5,RF24_CRC_16,ack_payload);
+}
+
+/**
+ * Worst case from CE to MAX_RT: settling, then every attempt on air
+ * followed by its retry delay
+ *
+ * @param retries ARC, 0-15
+ * @return Microseconds
+ */
+constexpr uint32_t rf24_worst_latency_us(rf24_datarate_e rate, uint8_t address_width,
+                                         rf24_crclength_e crc, uint8_t payload,
+                                         uint16_t ard_us, uint8_t retries)
+{
+  return RF24_SETTLE_US
+    + ( retries + 1UL ) * ( rf24_airtime_us(rate,address_width,crc,payload) + ard_us );
+}
+
+/**
+ * TX current of a PA level
+ *
+ * @return Microamps
+ */
+constexpr uint16_t rf24_tx_current_ua(rf24_pa_dbm_e level)
+{
+  return level == RF24_PA_MIN ? 7000 : level == RF24_PA_LOW ? 7500 : level == RF24_PA_HIGH ? 9000 : 11300;
+}
+
+/**
+ * RX current while waiting for an ack
+ *
+ * @return Microamps
+ */
+constexpr uint16_t rf24_rx_current_ua(rf24_datarate_e rate)
+{
+  return rate == RF24_250KBPS ? 12600 : rate == RF24_1MBPS ? 13100 : 13500;
+}
+
+/**
+ * Worst case radio charge of one send: settling, and every attempt on air
+ * followed by listening for the ack for the whole retry delay
+ *
+ * @return Nanocoulombs
+ */
+constexpr uint32_t rf24_worst_charge_nc(rf24_datarate_e rate, rf24_pa_dbm_e level,
+                                        uint8_t address_width, rf24_crclength_e crc,
+                                        uint8_t payload, uint16_t ard_us, uint8_t retries)
+{
+  return ( RF24_SETTLE_US * 8000UL
+           + ( retries + 1UL ) * ( (uint32_t) rf24_airtime_us(rate,address_width,crc,payload) * rf24_tx_current_ua(level)
+                                   + (uint32_t) ard_us * rf24_rx_current_ua(rate) ) ) / 1000;
+}
+
+/**
+ * Time of RF24::writeCopies(): every copy settles and goes on air once,
+ * with the gap between two copies
+ *
+ * @param copies Number of no-ack copies, at least 1
+ * @return Microseconds
+ */
+constexpr uint32_t rf24_copies_us(rf24_datarate_e rate, uint8_t address_width,
+                                  rf24_crclength_e crc, uint8_t payload,
+                                  uint8_t copies, uint16_t gap_us)
+{
+  return copies * (uint32_t) ( RF24_SETTLE_US + rf24_airtime_us(rate,address_width,crc,payload) )
+    + ( copies - 1UL ) * gap_us;
+}
+
+/**
+ * Radio charge of RF24::writeCopies(), the gaps in Standby-I left out
+ *
+ * @return Nanocoulombs
+ */
+constexpr uint32_t rf24_copies_charge_nc(rf24_datarate_e rate, rf24_pa_dbm_e level,
+                                         uint8_t address_width, rf24_crclength_e crc,
+                                         uint8_t payload, uint8_t copies)
+{
+  return copies * ( RF24_SETTLE_US * 8000UL
+                    + (uint32_t) rf24_airtime_us(rate,address_width,crc,payload) * rf24_tx_current_ua(level) ) / 1000;
+}
+
+// The datasheet rule has to cover the settling and a full 32 byte ack
+static_assert(rf24_ard_ok(RF24_250KBPS,rf24_min_ard_us(RF24_250KBPS,RF24_MAX_PAYLOAD),RF24_MAX_PAYLOAD),
+              "250KBPS ARD rule too short for a 32 byte ack");
+static_assert(rf24_ard_ok(RF24_1MBPS,rf24_min_ard_us(RF24_1MBPS,RF24_MAX_PAYLOAD),RF24_MAX_PAYLOAD),
+              "1MBPS ARD rule too short for a 32 byte ack");
+static_assert(rf24_ard_ok(RF24_2MBPS,rf24_min_ard_us(RF24_2MBPS,RF24_MAX_PAYLOAD),RF24_MAX_PAYLOAD),
+              "2MBPS ARD rule too short for a 32 byte ack");
+
+#endif // __RF24TIMING_H__
+// vim:ai:cin:sts=2 sw=2 ft=cpp
@@ -8,6 +8,11 @@ Includes
 ********************************************************************************/
 volatile uint64_t startTime = 0;
 
+static spi_job_t* volatile spi_queue[SPI_QUEUE_SIZE];
+static volatile uint8_t spi_queue_head = 0;  // job on the bus
+volatile uint8_t spi_queue_count = 0;
+static volatile uint8_t spi_job_pos = 0;     // bytes of the job clocked so far
+
 /* ======================================================= */
 // Set up a memory regions to access GPIO
 void setup_io()
@@ -25,36 +30,146 @@ void setup_spi()
 {
 	/* Enable SPI, Master, set clock rate fck/4 */
 	SPCR = (1<<SPE)|(1<<MSTR)|(0<<SPR1)|(0<<SPR0);
+	/* Double speed, fck/2 = 4 MHz, well below the 10 MHz of the nRF24L01 */
+	SPSR = (1<<SPI2X);
 } // setup_spi
 
 /* ======================================================= */
-void setCSN(uint8_t value)
+// Set up INT0 for the radio IRQ line (active low)
+void setup_irq()
 {
-	if (value) {
-		_on(SPI_CSN, PORTB);
-	} else {
-		_off(SPI_CSN, PORTB);
-	}
-}
+	_in(DDD2, DDRD); // IRQ
+	_on(RF_IRQ, PORTD); // pull-up, keeps the line defined while the radio is unpowered
+
+	/* Falling edge of INT0 generates an interrupt request */
+	EICRA = (EICRA & ~((1<<ISC01)|(1<<ISC00))) | (1<<ISC01);
+	EIFR = (1<<INTF0);
+	EIMSK |= (1<<INT0);
+} // setup_irq
 
 /* ======================================================= */
-void setCE(uint8_t value)
+// SPI block transfer, tx NULL sends 0xFF, rx NULL discards.
+// The next byte is fetched while the current one is shifted out,
+// so SPDR is reloaded right after SPIF with no gap on the bus.
+void transfer_spi_buffer(const uint8_t* tx, uint8_t* rx, uint8_t len)
 {
-	if (value) {
-		_on(SPI_CE, PORTB);
-	} else {
-		_off(SPI_CE, PORTB);
+	if (!len) {
+		return;
 	}
-}
+
+	/* Start transmission */
+	SPDR = tx ? *tx++ : 0xff;
+
+	while (--len) {
+		uint8_t out = tx ? *tx++ : 0xff;
+		/* Wait for transmission complete */
+		while(!(SPSR & (1<<SPIF)));
+		uint8_t in = SPDR;
+		SPDR = out;
+		if (rx) {
+			*rx++ = in;
+		}
+	}
+
+	while(!(SPSR & (1<<SPIF)));
+	uint8_t in = SPDR;
+	if (rx) {
+		*rx = in;
+	}
+} // transfer_spi_buffer
 
 /* ======================================================= */
-// SPI transfer
-uint8_t transfer_spi(uint8_t tx_)
+// SPI block write, tx NULL sends zeros (payload padding)
+void write_spi_buffer(const uint8_t* tx, uint8_t len)
 {
+	if (!len) {
+		return;
+	}
+
 	/* Start transmission */
-	SPDR = tx_;
-	/* Wait for transmission complete */
+	SPDR = tx ? *tx++ : 0;
+
+	while (--len) {
+		uint8_t out = tx ? *tx++ : 0;
+		/* Wait for transmission complete */
+		while(!(SPSR & (1<<SPIF)));
+		SPDR = out;
+	}
+
 	while(!(SPSR & (1<<SPIF)));
-	/* Return data register */
-	return SPDR;
-} // transfer_spi
+	/* Reading SPDR completes the SPIF clear sequence */
+	(void) SPDR;
+} // write_spi_buffer
+
+/* ======================================================= */
+// Frame a queued job with CSN and clock out its command byte
+static void spi_job_start(spi_job_t* job)
+{
+	spi_job_pos = 0;
+	setCSN(0);
+	SPDR = job->cmd;
+} // spi_job_start
+
+/* ======================================================= */
+// Queue a job, starts it right away if the bus is free.
+// Must not be called in the middle of a synchronous transaction.
+bool spi_queue_push(spi_job_t* job)
+{
+	bool result = false;
+	uint8_t sreg = SREG;
+
+	job->done = 0;
+
+	cli();
+	if (spi_queue_count < SPI_QUEUE_SIZE) {
+		spi_queue[(spi_queue_head + spi_queue_count) % SPI_QUEUE_SIZE] = job;
+		if (spi_queue_count++ == 0) {
+			SPCR |= (1<<SPIE);
+			spi_job_start(job);
+		}
+		result = true;
+	}
+	SREG = sreg;
+
+	return result;
+} // spi_queue_push
+
+/* ======================================================= */
+// Called from SPI_STC_vect, one byte of the current job completed
+void handle_spi_interrupt()
+{
+	spi_job_t* job = spi_queue[spi_queue_head];
+	uint8_t in = SPDR;
+	uint8_t pos = spi_job_pos;
+
+	if (pos == 0) {
+		job->status = in;
+	} else if (job->rx && pos <= job->len) {
+		job->rx[pos - 1] = in;
+	}
+
+	if (pos < job->len) {
+		SPDR = job->tx ? job->tx[pos] : 0xff;
+		spi_job_pos = pos + 1;
+		return;
+	}
+
+	if (pos < job->len + job->pad) {
+		SPDR = 0;
+		spi_job_pos = pos + 1;
+		return;
+	}
+
+	setCSN(1);
+	if (job->flags & SPI_JOB_CE_HIGH) {
+		setCE(1);
+	}
+	job->done = 1;
+
+	spi_queue_head = (spi_queue_head + 1) % SPI_QUEUE_SIZE;
+	if (--spi_queue_count) {
+		spi_job_start(spi_queue[spi_queue_head]);
+	} else {
+		SPCR &= ~(1<<SPIE);
+	}
+} // handle_spi_interrupt
@@ -1,21 +1,105 @@
+#ifndef ATMEGA328_H_
+#define ATMEGA328_H_
+
 /********************************************************************************
 Includes
 ********************************************************************************/
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <stdio.h>
 #include <util/delay.h>
 
 #include "../common/util.h"
 #include "../atmega328/mtimer.h"
+#include "spi_job.h"
 
 /********************************************************************************
 Macros and Defines
 ********************************************************************************/
 #define SPI_CSN PORTB1
 #define SPI_CE  PORTB2
+#define RF_IRQ  PORTD2
 
 /* =========== SPI and GPIO function ============ */
 void setup_io();
 void setup_spi();
-void setCSN(uint8_t value);
-void setCE(uint8_t value);
-uint8_t transfer_spi(uint8_t tx_);
+void setup_irq();
+void transfer_spi_buffer(const uint8_t* tx, uint8_t* rx, uint8_t len);
+void write_spi_buffer(const uint8_t* tx, uint8_t len);
+
+/* =========== Interrupt driven SPI queue ============ */
+bool spi_queue_push(spi_job_t* job);
+void handle_spi_interrupt();
+
+extern volatile uint8_t spi_queue_count;
+
+/* =========== Inline pin and byte access ============ */
+// With a constant argument these compile down to a single sbi/cbi
+
+static inline void setCSN(uint8_t value)
+{
+	if (value) {
+		_on(SPI_CSN, PORTB);
+	} else {
+		_off(SPI_CSN, PORTB);
+	}
+}
+
+static inline void setCE(uint8_t value)
+{
+	if (value) {
+		_on(SPI_CE, PORTB);
+	} else {
+		_off(SPI_CE, PORTB);
+	}
+}
+
+// SPI transfer
+static inline uint8_t transfer_spi(uint8_t tx_)
+{
+	/* Start transmission */
+	SPDR = tx_;
+	/* Wait for transmission complete */
+	while(!(SPSR & (1<<SPIF)));
+	/* Return data register */
+	return SPDR;
+}
+
+static inline bool spi_queue_idle()
+{
+	return spi_queue_count == 0;
+}
+
+// Synchronous transfers poll SPIF, they have to wait for the queue
+static inline void spi_queue_wait()
+{
+	while (spi_queue_count);
+}
+
+// Timer1 ticks, 128us each at clk/1024 (see mtimer.cpp), wraps every 8.4s
+#define PLATFORM_TICK_US 128
+
+static inline uint16_t platform_ticks()
+{
+	return TCNT1;
+}
+
+static inline void platform_delay_us(uint16_t micros)
+{
+	_delay_us(micros);
+}
+
+static inline void platform_delay_ms(uint16_t milisec)
+{
+	_delay_ms(milisec);
+}
+
+/* =========== Program memory ============ */
+#define PLATFORM_FLASH PROGMEM
+
+static inline void platform_read_flash(void* dst, const void* src, uint8_t len)
+{
+	memcpy_P(dst, src, len);
+}
+
+#endif /* ATMEGA328_H_ */
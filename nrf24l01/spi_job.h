@@ -0,0 +1,28 @@
+#ifndef SPI_JOB_H_
+#define SPI_JOB_H_
+
+/********************************************************************************
+Includes
+********************************************************************************/
+#include <stdint.h>
+
+/********************************************************************************
+Macros and Defines
+********************************************************************************/
+#define SPI_QUEUE_SIZE  4
+#define SPI_JOB_CE_HIGH 0x01 /* Raise CE once the job is clocked out */
+
+/* One CSN-framed transaction for the interrupt driven SPI queue.
+ * The buffers must stay valid until done is set. */
+typedef struct {
+	uint8_t cmd;              /* First byte, clocked in with STATUS */
+	const uint8_t* tx;        /* Data after cmd, NULL sends 0xFF */
+	uint8_t* rx;              /* Where to put the data, NULL discards */
+	uint8_t len;              /* Bytes of data after cmd */
+	uint8_t pad;              /* Zero bytes appended after the data */
+	uint8_t flags;            /* SPI_JOB_* */
+	volatile uint8_t status;  /* Byte received while cmd went out */
+	volatile uint8_t done;    /* Set by the ISR when CSN went high */
+} spi_job_t;
+
+#endif /* SPI_JOB_H_ */
@@ -0,0 +1,102 @@
+/********************************************************************************
+	Includes
+********************************************************************************/
+
+#include "batch.h"
+
+extern "C" {
+#include "../common/tscodec.h"
+}
+
+/********************************************************************************
+	Global Variables
+********************************************************************************/
+typedef struct {
+	int16_t temperature;
+	int16_t humidity;
+} sample_t;
+
+static sample_t batch_ring[BATCH_RING_SIZE];
+static uint8_t batch_head = 0;
+static uint8_t batch_size = 0;
+
+/********************************************************************************
+	Functions
+********************************************************************************/
+
+/**
+ * Stores one sample, in tenths of a degree and of a percent.
+ * A full ring drops its oldest sample.
+ */
+void batch_add(int16_t temperature, int16_t humidity) {
+	if (batch_size == BATCH_RING_SIZE) {
+		batch_drop(1);
+	}
+
+	sample_t *sample = &batch_ring[(batch_head + batch_size) % BATCH_RING_SIZE];
+	sample->temperature = temperature;
+	sample->humidity = humidity;
+	batch_size++;
+}
+
+uint8_t batch_count() {
+	return batch_size;
+}
+
+/**
+ * Packs as many of the oldest samples as fit between a header of
+ * header_size bytes and the end of the size byte frame, and fills in the
+ * fields the two frame types share.
+ */
+static uint8_t encode(uint8_t *frame, uint8_t size, uint8_t header_size, uint8_t type, uint8_t period) {
+	ts_encoder_t enc;
+
+	ts_encoder_init(&enc, frame + header_size, size - header_size);
+	for (uint8_t i = 0; i < batch_size; i++) {
+		const sample_t *sample = &batch_ring[(batch_head + i) % BATCH_RING_SIZE];
+		int16_t values[2] = { sample->temperature, sample->humidity };
+
+		if (!ts_encode(&enc, values, 2)) {
+			break;
+		}
+	}
+
+	frame[0] = 100;
+	frame[1] = 1;
+	frame[2] = type;
+	frame[3] = enc.count;
+	frame[4] = period;
+
+	return header_size + ts_encoded_length(&enc);
+}
+
+/**
+ * Packs as many of the oldest samples as fit into size bytes of frame, at
+ * most BATCH_FRAME_SIZE.  period is the sampling interval in Timer 2
+ * wakeups (8s), for the gateway to date the samples back from the time of
+ * arrival.  frame[3] holds the number of samples packed.
+ * Returns the frame length, the samples stay queued until batch_drop().
+ */
+uint8_t batch_encode(uint8_t *frame, uint8_t size, uint8_t period) {
+	return encode(frame, size, BATCH_HEADER_SIZE, BATCH_MSG_TYPE, period);
+}
+
+/**
+ * Same as batch_encode(), for a frame sent without acknowledgment.  seq
+ * tells the gateway which copies are repeats of the same frame.
+ */
+uint8_t batch_encode_seq(uint8_t *frame, uint8_t size, uint8_t period, uint8_t seq) {
+	frame[5] = seq;
+	return encode(frame, size, BATCH_SEQ_HEADER_SIZE, BATCH_SEQ_MSG_TYPE, period);
+}
+
+/**
+ * Forgets the count oldest samples, once the gateway acknowledged them.
+ */
+void batch_drop(uint8_t count) {
+	if (count > batch_size) {
+		count = batch_size;
+	}
+	batch_head = (batch_head + count) % BATCH_RING_SIZE;
+	batch_size -= count;
+}
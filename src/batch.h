@@ -0,0 +1,36 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+/********************************************************************************
+	Includes
+********************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/********************************************************************************
+	Macros and Defines
+********************************************************************************/
+// Frame: {100, 1, BATCH_MSG_TYPE, count, period} followed by the samples,
+// temperature and humidity in tenths, coded by common/tscodec.c
+#define BATCH_MSG_TYPE		4
+#define BATCH_HEADER_SIZE	5
+
+// Frame sent as unacknowledged copies: {100, 1, BATCH_SEQ_MSG_TYPE, count,
+// period, seq}, the gateway keeps the first copy of each seq
+#define BATCH_SEQ_MSG_TYPE		6
+#define BATCH_SEQ_HEADER_SIZE	6
+#define BATCH_FRAME_SIZE	32
+
+// Room for a couple of frames, so a failed send does not lose data
+#define BATCH_RING_SIZE		16
+
+/********************************************************************************
+	Function Prototypes
+********************************************************************************/
+void batch_add(int16_t temperature, int16_t humidity);
+uint8_t batch_count();
+uint8_t batch_encode(uint8_t *frame, uint8_t size, uint8_t period);
+uint8_t batch_encode_seq(uint8_t *frame, uint8_t size, uint8_t period, uint8_t seq);
+void batch_drop(uint8_t count);
+
+#endif /* BATCH_H_ */
@@ -2,18 +2,30 @@
 	Includes
 ********************************************************************************/
 
+#include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <avr/sleep.h>
+#include <avr/wdt.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <util/delay.h>
 
 #include "../nrf24l01/RF24.h"
+#include "../nrf24l01/RF24Config.h"
+#include "../nrf24l01/RF24Link.h"
+#include "../nrf24l01/RF24LinkStats.h"
+#include "../nrf24l01/RF24Timing.h"
 #include "../atmega328/mtimer.h"
+#include "../boot/ota.h"
+#include "../common/log.h"
+#include "../common/seal.h"
+#include "../common/trace.h"
 #include "../common/util.h"
 #include "../dht/dht.h"
+#include "batch.h"
 
 extern "C" {
 #include "../ds18x20/ds18x20lib.h"
@@ -23,29 +35,190 @@ extern "C" {
 /********************************************************************************
 	Macros and Defines
 ********************************************************************************/
-
+// What the radio runs with, RF24::begin() picks the rate and CRC
+#define RADIO_RATE RF24_250KBPS
+#define RADIO_CRC RF24_CRC_16
+#define RADIO_ADDRESS_WIDTH 5
+#define RADIO_RETRIES 15
+
+// Upper bound for one ESB send: the longest frame with every retry at the
+// longest delay RF24Link may back off to, plus margin
+#define RADIO_TX_TIMEOUT_MS (rf24_worst_latency_us(RADIO_RATE, RADIO_ADDRESS_WIDTH, RADIO_CRC, \
+		BATCH_FRAME_SIZE, RF24_ARD_MAX_US, RADIO_RETRIES) / 1000 + 10)
+
+// Timer 2 wakes us every 8s, 450 wakeups are one hour
+#define SEND_PERIOD_TICKS 450
+
+// USART RX can not wake the node from Power-save.  The first edge on RXD
+// does, through its pin change interrupt, and opens a console session:
+// the node sleeps in Idle, where the USART receives, until nothing came
+// in for CONSOLE_SESSION_TICKS Timer 2 wakeups.  That first key is lost.
+#define CONSOLE_SESSION_TICKS 8
+
+// Batching samples more often and sends them as one frame per SEND_PERIOD_TICKS,
+// 0 sends every reading on its own like before
+#define BATCH_MODE 1
+#define BATCH_SAMPLES_PER_SEND 12
+
+// Telemetry without acks: each batch frame goes out TELEMETRY_COPIES times
+// as a no-ack payload, TELEMETRY_GAP_US apart, and leaves the ring whether
+// it arrived or not.  The send takes a fixed time and the radio never
+// listens for an ack, but RF24Link gets no feedback and the gateway can not
+// send settings.  0 keeps Enhanced ShockBurst with retries.
+#define TELEMETRY_COPIES 0
+#define TELEMETRY_GAP_US 2000
+
+// Sealed frames, see common/seal.h.  Each node gets its own key in EEPROM
+// at SEAL_EE_KEY when it is provisioned, the firmware image stays the same
+// for all.  The gateway may seal its downlinks too, with counters from
+// SEAL_DOWNLINK up; only a sealed one can ask for a firmware update.
+// Frame counters are reserved SEAL_COUNTER_BLOCK at a time, one EEPROM
+// write per that many frames.  0 sends in clear.
+#define SEAL_FRAMES 0
+#define SEAL_COUNTER_BLOCK 256
+
+// Firmware updates over the radio, see boot/ota.h.  Needs the bootloader
+// and its fuses on the node, and sealed frames: the request must come
+// sealed and the bootloader checks the image with the node key.
+// 0 ignores the update request.
+#define OTA_UPDATES 0
+
+static_assert(!OTA_UPDATES || SEAL_FRAMES, "firmware updates need sealed frames");
+
+#if SEAL_FRAMES
+#define UPLINK_MAX_LEN (RF24_MAX_PAYLOAD - SEAL_OVERHEAD)
+#else
+#define UPLINK_MAX_LEN RF24_MAX_PAYLOAD
+#endif
+
+// Channel selection, the gateway knows the same candidate list.
+// The node surveys at boot and once a day, and proposes a quieter channel
+// with a {100, 1, CHANNEL_MSG_TYPE, channel} message on the current one.
+// Both move once the proposal is acknowledged.  After CHANNEL_FALLBACK_FAILS
+// failed sends in a row the node returns to the home channel, the gateway
+// does the same when it hears nothing for two send periods.
+#define CHANNEL_HOME 110
+#define CHANNEL_MSG_TYPE 5
+#define CHANNEL_SURVEY_ROUNDS 16
+#define CHANNEL_SWITCH_MARGIN 2
+#define CHANNEL_SURVEY_TICKS 10800
+#define CHANNEL_FALLBACK_FAILS 2
+
+// Downlink, the gateway queues {DOWNLINK_MSG_TYPE, param, value_lo, value_hi, ...}
+// as the ack payload of our next uplink, at most DOWNLINK_MAX_LEN bytes so the
+// ack still fits into a 750us retry delay at 250KBPS.  Sealed, it is
+// {100, 1, DOWNLINK_MSG_TYPE}, param, value_lo, value_hi through seal(), one
+// setting per ack, and the retry delay grows to fit it.
+#define DOWNLINK_MSG_TYPE 1
+#if SEAL_FRAMES
+#define DOWNLINK_MAX_LEN (SEAL_HEADER_SIZE + SEAL_OVERHEAD + 3)
+#else
+#define DOWNLINK_MAX_LEN 8
+#endif
+#define DOWNLINK_SEND_PERIOD 1		// Timer 2 wakeups between sends
+#define DOWNLINK_SAMPLES 2			// samples per send in batch mode
+#define DOWNLINK_SURVEY_PERIOD 3	// Timer 2 wakeups between channel surveys
+#define DOWNLINK_OTA 4				// OTA_DOWNLINK_MAGIC, reset into the bootloader
+
+// Link statistics, see RF24LinkStats.h.  A {100, 1, LINK_MSG_TYPE, summary}
+// frame follows every LINK_REPORT_SENDS batch, once a day by default
+#define LINK_MSG_TYPE 7
+#define LINK_REPORT_SENDS 24
+
+static_assert(RADIO_RETRIES == RF24_LINK_ARC, "RF24Link sets the retry count");
+static_assert(RADIO_TX_TIMEOUT_MS * 3 < 1000, "a burst of three must not stall the node for a second");
+static_assert(3 + RF24_LINK_STATS_SUMMARY <= UPLINK_MAX_LEN, "the link report must fit a frame");
+static_assert(!TELEMETRY_COPIES || rf24_copies_us(RADIO_RATE, RADIO_ADDRESS_WIDTH, RADIO_CRC,
+		BATCH_FRAME_SIZE, TELEMETRY_COPIES, TELEMETRY_GAP_US) < RADIO_TX_TIMEOUT_MS * 1000UL,
+		"telemetry copies must not take longer than an acknowledged send");
+
+// The whole radio setup, built into a register image in flash.  PA level
+// and retry delay are where RF24Link starts, see RF24Link::begin().
+// Payloads go out at the length of the message, no zero padding, and the
+// gateway answers with settings in the ack, see handleDownlink().
+constexpr rf24_config_t radio_config = { RADIO_RATE, RADIO_CRC, RF24_PA_MAX,
+		CHANNEL_HOME, RADIO_ADDRESS_WIDTH, rf24_min_ard_us(RADIO_RATE, DOWNLINK_MAX_LEN),
+		RADIO_RETRIES, RF24_MAX_PAYLOAD, true, DOWNLINK_MAX_LEN,
+		0xF0F0F0F0E1LL, 0xF0F0F0F0D2LL };
+RF24_CHECK_CONFIG(radio_config);
+static_assert(radio_config.address_width == 5 && radio_config.dynamic_payloads && radio_config.ack_payload,
+		"beginRadio() sets up the radio the same way without the image");
 
 /********************************************************************************
 	Function Prototypes
 ********************************************************************************/
 void initTimer2();
 void readAndSendTemperature();
+void sampleTemperature();
+void sendBatch();
+void checkRadio();
+bool beginRadio();
+void selectChannel();
+void trackDelivery(bool delivered);
+void sendLinkReport();
+void enterBootloader();
+void handleDownlink();
+bool applySetting(uint8_t param, uint16_t value, bool sealed);
+int8_t openDownlink(uint8_t* buf, uint8_t len);
+bool sendPacket(const void* buf, uint8_t len);
+void initSeal();
+uint8_t sealFrame(uint8_t* sealed, const void* buf, uint8_t len);
+uint8_t sendBurst(const void* const* bufs, const uint8_t* lens, uint8_t count);
+bool waitForRadio(uint64_t startTime);
+void sleepUntilWakeup();
 
 /********************************************************************************
 	Global Variables
 ********************************************************************************/
 volatile uint16_t timer2_count = 3600;
+volatile bool timer2_tick = false;
+// Timer 2 wakeups left in the console session, 0 when there is none
+volatile uint8_t console_ticks = 0;
+// Sampling periods since the last send, or since the first sample after it
+uint16_t batch_age = 0;
+uint16_t survey_ticks = 0;
+uint8_t failed_sends = 0;
+uint8_t telemetry_seq = 0;
+uint8_t link_report_sends = 0;
+bool link_degrading = false;
+bool survey_now = false;			// survey at the next wakeup, whatever the period
+bool ota_requested = false;
+
+// Settings the gateway can change, see applySetting()
+uint16_t send_period_ticks = SEND_PERIOD_TICKS;
+uint8_t samples_per_send = BATCH_SAMPLES_PER_SEND;
+uint16_t survey_period_ticks = CHANNEL_SURVEY_TICKS;
 
 RF24 radio;
-const uint64_t pipes[2] = { 0xF0F0F0F0E1LL, 0xF0F0F0F0D2LL };
+RF24Link radio_link(radio);
+RF24LinkStats link_stats(radio);
+const rf24_image_t radio_image PLATFORM_FLASH = rf24_config_image(radio_config);
+// Home channel first, the rest above the 2.4GHz WiFi channels
+const uint8_t radio_channels[] = { CHANNEL_HOME, 100, 105, 115, 120, 125 };
 DHT dht(DHT22);
 
+#if SEAL_FRAMES
+uint32_t seal_counter_ee EEMEM;		// first counter not yet used
+uint32_t seal_downlink_ee EEMEM;	// last downlink counter taken
+seal_key_t seal_key;
+uint32_t seal_counter = 0;
+uint32_t seal_reserved = 0;			// counters below are reserved in EEPROM
+#endif
+
 /********************************************************************************
 	Interrupt Service
 ********************************************************************************/
 ISR(USART_RX_vect)
 {
 	handle_usart_interrupt();
+	console_ticks = CONSOLE_SESSION_TICKS;
+}
+
+ISR(PCINT2_vect)
+{
+	// Edge on RXD while in Power-save, stay awake for the rest of the line
+	PCMSK2 &= ~_BV(PCINT16);
+	console_ticks = CONSOLE_SESSION_TICKS;
 }
 
 ISR(TIMER1_OVF_vect)
@@ -53,14 +226,19 @@ ISR(TIMER1_OVF_vect)
 	incrementOvf();
 }
 
+ISR(SPI_STC_vect)
+{
+	handle_spi_interrupt();
+}
+
 ISR(INT0_vect)
 {
-	//printf("\n%i", index++);
+	radio.irq();
 }
 
 ISR(TIMER2_OVF_vect)
 {
-	_NOP();
+	timer2_tick = true;
 }
 
 /********************************************************************************
@@ -82,20 +260,28 @@ int main(void) {
     // Configure Sleep Mode - Power-save
     SMCR = (0<<SM2)|(1<<SM1)|(1<<SM0)|(0<<SE);
 
+    // Pin change on RXD opens a console session, see sleepUntilWakeup()
+    PCICR |= _BV(PCIE2);
+
+	// What reset us: power on, external, brown-out or watchdog
+	trace(TRACE_BOOT, MCUSR);
+
 	// Output initialization log
-    printf("Start...");
-    printf(CONSOLE_PREFIX);
+    printf_P(PSTR("Start..."));
+    printf_P(PSTR(CONSOLE_PREFIX));
+
+#if SEAL_FRAMES
+    initSeal();
+#endif
 
-    radio.begin();
-    radio.setRetries(15,15);
-    radio.setPayloadSize(8);
-    radio.setPALevel(RF24_PA_MAX);
-    radio.setChannel(110);
+    if (!beginRadio()) {
+        radio.printDetails();
+    }
 
-    radio.openWritingPipe(pipes[0]);
-    radio.openReadingPipe(1,pipes[1]);
+    radio_link.begin(DOWNLINK_MAX_LEN);
+    radio.enableIRQ();
 
-    radio.printDetails();
+    selectChannel();
 
     _delay_ms(10);
     radio.powerDown();
@@ -107,17 +293,53 @@ int main(void) {
 
 	// main loop
     while (1) {
-    	// main usart loop
-    	//usart_check_loop();
+    	// main usart loop, runs the console commands received since the last wakeup
+    	usart_check_loop();
 
     	// Sleep mode to save battery, Timer 2 will wake up once each 8 seconds
-		sleep_mode();
+		sleepUntilWakeup();
 
+		// console input and Timer 1 wake us in Idle too, only count Timer 2
+		if (!timer2_tick) {
+			continue;
+		}
+		timer2_tick = false;
+		if (console_ticks) {
+			console_ticks--;
+		}
+
+#if BATCH_MODE
+		// sample every few minutes, samples_per_send per send period
+		if (++timer2_count >= send_period_ticks / samples_per_send) {
+			trace(TRACE_WAKE, timer2_count);
+			timer2_count = 0;
+			sampleTemperature();
+
+			// missed readings must not hold samples back, send what we have when due
+			if (batch_count() && ++batch_age >= samples_per_send) {
+				batch_age = 0;
+				sendBatch();
+			}
+		}
+#else
 		// each hour send the data
-		if (++timer2_count >= 450) {
+		if (++timer2_count >= send_period_ticks) {
 			timer2_count = 0;
 			readAndSendTemperature();
 		}
+#endif
+
+		// once a day look for a quieter channel, or right away if sends degrade
+		if (survey_now || (survey_period_ticks && ++survey_ticks >= survey_period_ticks)) {
+			survey_ticks = 0;
+			survey_now = false;
+			selectChannel();
+		}
+
+		// the ack that asked for it is in, the gateway now waits for the bootloader
+		if (ota_requested) {
+			enterBootloader();
+		}
     }
 }
 
@@ -151,8 +373,8 @@ void readAndSendTemperature() {
 	    uint8_t h_low = (uint8_t) h_int;
 	    uint8_t h_high = (uint8_t) (h_int>>8);
 
-	    debug_print("h_high=%d", h_high);
-	    debug_print("h_low=%d", h_low);
+	    log_debug(APP, "h_high=%d", h_high);
+	    log_debug(APP, "h_low=%d", h_low);
 
 		double t = dht.getTemperature() * 10.00f;
 	    int16_t t_int = (int16_t) t;
@@ -161,32 +383,26 @@ void readAndSendTemperature() {
 	    uint8_t t_low = (uint8_t) t_int;
 	    uint8_t t_high = (uint8_t) (t_int>>8);
 
-	    debug_print("t_high=%d", t_high);
-	    debug_print("t_low=%d", t_low);
+	    log_debug(APP, "t_high=%d", t_high);
+	    log_debug(APP, "t_low=%d", t_low);
 
 	    // Send data to server via RF link
+	    // No settling delay here, the first send waits for the oscillator
 	    radio.powerUp();
-	    _delay_ms(50);
 
-	    // Send temperature via NRF24L01 transceiver
+	    // Send temperature and humidity via NRF24L01 transceiver in one burst
 		uint8_t data1[] = {100, 1, 1, t_high, t_low};
-		radio.write(data1, 5);
-
-		_delay_ms(10);
-
-		// need to flush tx buffer, fixed the issue with packet shift...
-		radio.stopListening();
-
-		_delay_ms(200);
-
-	    // Send humidity via NRF24L01 transceiver
 		uint8_t data2[] = {100, 1, 2, h_high, h_low};
-		radio.write(data2, 5);
+		const void* bufs[] = {data1, data2};
+		const uint8_t lens[] = {sizeof(data1), sizeof(data2)};
 
-		_delay_ms(10);
+		uint8_t delivered = sendBurst(bufs, lens, 2);
+		log_debug(APP, "delivered=%x", delivered);
+
+		if (!delivered) {
+			checkRadio();
+		}
 
-		// need to flush tx buffer, fixed the issue with packet shift...
-		radio.stopListening();
 	    radio.powerDown();
 
 		// Wait a little before going to sleep again
@@ -194,6 +410,471 @@ void readAndSendTemperature() {
 	}
 }
 
+/**
+ * Reads the DHT22 into the batch ring, in tenths of a degree and of a percent.
+ */
+void sampleTemperature() {
+	if (dht.read()) {
+		int16_t t_int = (int16_t) (dht.getTemperature() * 10.00f);
+		int16_t h_int = (int16_t) (dht.getHumidity() * 10.00f);
+
+		batch_add(t_int, h_int);
+		trace(TRACE_SAMPLE, t_int);
+		log_debug(APP, "batched t=%d h=%d n=%d", t_int, h_int, batch_count());
+	}
+}
+
+/**
+ * Sends the oldest batched samples as one frame. They stay in the ring
+ * for the next attempt unless the gateway acknowledged them, or right
+ * away as unacknowledged copies with TELEMETRY_COPIES.
+ */
+void sendBatch() {
+	uint8_t frame[BATCH_FRAME_SIZE];
+	uint8_t period = send_period_ticks / samples_per_send;
+
+#if TELEMETRY_COPIES
+	uint8_t len = batch_encode_seq(frame, UPLINK_MAX_LEN, period, telemetry_seq++);
+
+	trace(TRACE_SEND, frame[3]);
+	radio.powerUp();
+#if SEAL_FRAMES
+	// Every copy carries the same counter, the gateway takes the first one
+	uint8_t sealed[RF24_MAX_PAYLOAD];
+	len = sealFrame(sealed, frame, len);
+	uint8_t sent = radio.writeCopies(sealed, len, TELEMETRY_COPIES, TELEMETRY_GAP_US);
+#else
+	uint8_t sent = radio.writeCopies(frame, len, TELEMETRY_COPIES, TELEMETRY_GAP_US);
+#endif
+	log_info(APP, "batch of %d sent %d times", frame[3], sent);
+
+	// Nobody tells us whether it arrived, the samples go either way
+	batch_drop(frame[3]);
+	if (!sent) {
+		checkRadio();
+	}
+#else
+	uint8_t len = batch_encode(frame, UPLINK_MAX_LEN, period);
+
+	trace(TRACE_SEND, frame[3]);
+	radio.powerUp();
+	bool delivered = sendPacket(frame, len);
+	log_info(APP, "batch of %d delivered=%d", frame[3], delivered);
+
+	if (delivered) {
+		batch_drop(frame[3]);
+	} else {
+		checkRadio();
+	}
+#endif
+
+	if (++link_report_sends >= LINK_REPORT_SENDS) {
+		link_report_sends = 0;
+		sendLinkReport();
+	}
+
+	radio.powerDown();
+}
+
+/**
+ * Sends the link statistics, the counts since the last report restart
+ * once the gateway has them.  The radio must be powered up.
+ */
+void sendLinkReport() {
+	uint8_t frame[3 + RF24_LINK_STATS_SUMMARY] = {100, 1, LINK_MSG_TYPE};
+
+	link_stats.getSummary(frame + 3);
+	if (sendPacket(frame, sizeof frame)) {
+		link_stats.clearPeriod();
+	}
+}
+
+/**
+ * Brings the radio up from the flash image in one pass, no settling delay
+ * unless the chip is still in power on reset.  If it does not verify, the
+ * addresses were never written: start over with begin() and the setters.
+ * Returns false in that case.
+ */
+bool beginRadio() {
+	if (radio.beginFromFlash(&radio_image)) {
+		return true;
+	}
+
+	log_error(APP, "radio does not verify, configuring from scratch");
+	radio.begin();
+	radio.setDataRate(radio_config.rate);
+	radio.setCRCLength(radio_config.crc);
+	radio.setPALevel(radio_config.pa_level);
+	radio.setChannel(radio_config.channel);
+	radio.setRetries(rf24_ard_code(radio_config.ard_us), radio_config.retries);
+	radio.enableDynamicPayloads();
+	radio.enableAckPayload();
+	// the address width stays at its reset value, 5 bytes
+	radio.openWritingPipe(radio_config.tx_address);
+	radio.openReadingPipe(1, radio_config.rx_address);
+
+	return false;
+}
+
+/**
+ * Nothing got through, check the radio did not lose its configuration.
+ */
+void checkRadio() {
+	if (!radio.verifyRegisters()) {
+		// It lost power, start over on the same channel
+		uint8_t channel = radio.getChannel();
+		beginRadio();
+		radio.setChannel(channel);
+		radio_link.begin(DOWNLINK_MAX_LEN);
+	}
+}
+
+/**
+ * Sleeps in Idle mode until the radio raises INT0 or the send timed out.
+ * Idle keeps the I/O clock running, so the falling IRQ edge can wake us up.
+ * Returns false on the timeout.
+ */
+bool waitForRadio(uint64_t startTime) {
+	// Configure Sleep Mode - Idle
+	SMCR = (0<<SM2)|(0<<SM1)|(0<<SM0)|(0<<SE);
+
+	while (radio.isTxPending() && getElapsedMilliseconds(startTime) < RADIO_TX_TIMEOUT_MS) {
+		// sei() executes the next instruction before any pending interrupt,
+		// so an IRQ between the check and sleep_cpu() can not be missed
+		cli();
+		if (radio.isTxPending()) {
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		sei();
+	}
+
+	// Configure Sleep Mode - Power-save
+	SMCR = (0<<SM2)|(1<<SM1)|(1<<SM0)|(0<<SE);
+
+	return !radio.isTxPending();
+}
+
+/**
+ * Sleeps until the next interrupt, in Power-save unless a console session
+ * is open.  Then it is Idle, which keeps the USART receiving.
+ */
+void sleepUntilWakeup() {
+	cli();
+	if (console_ticks) {
+		// Configure Sleep Mode - Idle
+		SMCR = (0<<SM2)|(0<<SM1)|(0<<SM0)|(0<<SE);
+	} else {
+		// Configure Sleep Mode - Power-save, the next edge on RXD wakes us
+		SMCR = (0<<SM2)|(1<<SM1)|(1<<SM0)|(0<<SE);
+		PCIFR = _BV(PCIF2);
+		PCMSK2 |= _BV(PCINT16);
+	}
+
+	// as in waitForRadio(), an interrupt before sleep_cpu() still wakes us
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+
+	// Configure Sleep Mode - Power-save
+	SMCR = (0<<SM2)|(1<<SM1)|(1<<SM0)|(0<<SE);
+}
+
+/**
+ * Sends one payload, sleeping while the SPI interrupt uploads it and
+ * while the radio does the ESB retries.
+ */
+bool sendPacket(const void* buf, uint8_t len) {
+	static spi_job_t job;
+	uint64_t startTime = getCurrentTimeCicles();
+
+#if SEAL_FRAMES
+	uint8_t sealed[RF24_MAX_PAYLOAD];
+	len = sealFrame(sealed, buf, len);
+	buf = sealed;
+#endif
+
+	if (!radio.startWriteQueued(&job, buf, len)) {
+		radio.startWrite(buf, len);
+	}
+	waitForRadio(startTime);
+
+	bool delivered = radio.finishWrite();
+	trackDelivery(delivered);
+
+	return delivered;
+}
+
+/**
+ * Sends up to three payloads on one CE pulse, sleeping between the IRQs.
+ * Returns the delivery bit mask, bit n set if payload n was acknowledged.
+ */
+uint8_t sendBurst(const void* const* bufs, const uint8_t* lens, uint8_t count) {
+	uint64_t startTime = getCurrentTimeCicles();
+
+#if SEAL_FRAMES
+	uint8_t sealed[3][RF24_MAX_PAYLOAD];
+	const void* sealed_bufs[3];
+	uint8_t sealed_lens[3];
+
+	count = count < 3 ? count : 3;
+	for (uint8_t i = 0; i < count; i++) {
+		sealed_lens[i] = sealFrame(sealed[i], bufs[i], lens[i]);
+		sealed_bufs[i] = sealed[i];
+	}
+	bufs = sealed_bufs;
+	lens = sealed_lens;
+#endif
+
+	radio.startBurst(bufs, lens, count);
+
+	// Every IRQ ends a payload, the next one gets a timeout of its own
+	while (true) {
+		bool irq = waitForRadio(startTime);
+		if (radio.serviceBurst() || !irq) {
+			break;
+		}
+		startTime = getCurrentTimeCicles();
+	}
+
+	uint8_t delivered = radio.finishBurst();
+	trackDelivery(delivered == (1 << count) - 1);
+
+	return delivered;
+}
+
+#if SEAL_FRAMES
+/**
+ * Expands the node key and picks up the frame counter where the last
+ * reservation ended, counters handed out before a reset are never reused.
+ */
+void initSeal() {
+	uint8_t node_key[SEAL_KEY_SIZE];
+	uint8_t erased = 0xff;
+
+	eeprom_read_block(node_key, SEAL_EE_KEY, sizeof node_key);
+	for (uint8_t i = 0; i < sizeof node_key; i++) {
+		erased &= node_key[i];
+	}
+	if (erased == 0xff) {
+		log_error(APP, "no node key in EEPROM");
+	}
+	seal_init(&seal_key, node_key);
+	memset(node_key, 0, sizeof node_key);
+
+	seal_counter = eeprom_read_dword(&seal_counter_ee);
+	if (seal_counter == 0xffffffff) {
+		seal_counter = 0;
+	}
+	seal_reserved = seal_counter;
+}
+
+/**
+ * Opens a sealed downlink in place.  Its counter must be one of the
+ * gateway's and above the last one taken, which is kept in EEPROM so a
+ * reset does not open the node to replays.
+ * Returns the plain length, -1 if it does not open or is a replay.
+ */
+int8_t openDownlink(uint8_t* buf, uint8_t len) {
+	uint32_t counter;
+	uint32_t taken = eeprom_read_dword(&seal_downlink_ee);
+
+	if (taken == 0xffffffff) {
+		taken = 0;
+	}
+
+	int8_t plain = seal_open(&seal_key, buf, len, &counter);
+	if (plain < 0 || counter < SEAL_DOWNLINK || counter <= taken) {
+		return -1;
+	}
+	eeprom_update_dword(&seal_downlink_ee, counter);
+
+	return plain;
+}
+
+/**
+ * Seals a copy of the len byte frame at buf into sealed, which holds
+ * RF24_MAX_PAYLOAD bytes.  Returns the sealed length.
+ */
+uint8_t sealFrame(uint8_t* sealed, const void* buf, uint8_t len) {
+	if (seal_counter == seal_reserved) {
+		seal_reserved += SEAL_COUNTER_BLOCK;
+		eeprom_update_dword(&seal_counter_ee, seal_reserved);
+	}
+
+	memcpy(sealed, buf, len);
+	return seal(&seal_key, sealed, len, seal_counter++);
+}
+#endif
+
+/**
+ * Feeds the link controller and falls back to the home channel when the
+ * gateway stopped answering on a surveyed one.
+ */
+void trackDelivery(bool delivered) {
+	link_stats.update(delivered);
+	radio_link.update(delivered);
+	trace(TRACE_DELIVERY, delivered | (failed_sends << 8));
+
+	if (delivered) {
+		failed_sends = 0;
+		handleDownlink();
+	} else if (++failed_sends >= CHANNEL_FALLBACK_FAILS && radio.getChannel() != CHANNEL_HOME) {
+		log_warn(APP, "back to channel %d", CHANNEL_HOME);
+		trace(TRACE_CHANNEL, CHANNEL_HOME);
+		radio.setChannel(CHANNEL_HOME);
+		failed_sends = 0;
+	}
+
+	// Sends failing more than they used to, survey at the next wakeup
+	// instead of waiting for the daily one, also with the daily one turned off
+	bool degrading = link_stats.isDegrading();
+	if (degrading && !link_degrading) {
+		log_warn(APP, "link degrading, %d/255 delivered", link_stats.getFastSuccess());
+		survey_now = true;
+	}
+	link_degrading = degrading;
+}
+
+/**
+ * Applies the settings the gateway sent along with its acks, if any.
+ * They arrive with the uplink we send anyway, the radio never listens for them.
+ */
+void handleDownlink() {
+	uint8_t buf[32];
+	bool last;
+
+	if (!radio.isAckPayloadAvailable()) {
+		return;
+	}
+
+	// a burst can bring one ack payload per payload sent
+	do {
+		uint8_t len = radio.getDynamicPayloadSize();
+		uint8_t first = 1;
+		bool sealed = false;
+		last = radio.read(buf, len);
+
+#if SEAL_FRAMES
+		if (len >= SEAL_HEADER_SIZE && buf[2] == (DOWNLINK_MSG_TYPE | SEAL_MSG_FLAG)) {
+			int8_t plain = openDownlink(buf, len);
+			if (plain < 0) {
+				log_warn(APP, "downlink does not open");
+				continue;
+			}
+			len = plain;
+			first = SEAL_HEADER_SIZE;
+			sealed = true;
+		} else
+#endif
+		if (len < 1 || buf[0] != DOWNLINK_MSG_TYPE) {
+			continue;
+		}
+		for (uint8_t i = first; i + 3 <= len; i += 3) {
+			uint16_t value = buf[i + 1] | (buf[i + 2] << 8);
+			bool ok = applySetting(buf[i], value, sealed);
+			trace(TRACE_DOWNLINK, ok | (buf[i] << 8));
+			log_info(APP, "downlink %d=%u %S", buf[i], value, ok ? PSTR("ok") : PSTR("rejected"));
+		}
+	} while (!last);
+}
+
+/**
+ * Checks and applies one downlink setting, returns false if it was out of
+ * range or needs a sealed downlink and did not come in one.
+ */
+bool applySetting(uint8_t param, uint16_t value, bool sealed) {
+	switch (param) {
+	case DOWNLINK_SEND_PERIOD:
+		// 5 minutes to 8 hours, and a sampling period that fits the frame header
+		if (value < 38 || value > 3600 || value / samples_per_send > 255) {
+			return false;
+		}
+		send_period_ticks = value;
+		return true;
+
+	case DOWNLINK_SAMPLES:
+		if (value < 1 || value > BATCH_RING_SIZE || send_period_ticks / value > 255) {
+			return false;
+		}
+		samples_per_send = value;
+		return true;
+
+	case DOWNLINK_SURVEY_PERIOD:
+		// at least one hour, 0 turns the survey off
+		if (value && value < 450) {
+			return false;
+		}
+		survey_period_ticks = value;
+		return true;
+
+#if OTA_UPDATES
+	case DOWNLINK_OTA:
+		// a stray setting must not take the node off the air, nor anyone
+		// who can put an ack payload on the air
+		if (!sealed || value != OTA_DOWNLINK_MAGIC) {
+			return false;
+		}
+		ota_requested = true;
+		return true;
+#endif
+	}
+
+	return false;
+}
+
+/**
+ * Leaves the application for the radio bootloader: the flag in EEPROM
+ * sends the next reset into the update, the watchdog makes that reset.
+ * Does not return.
+ */
+void enterBootloader() {
+	log_info(APP, "reset for update");
+	radio.powerDown();
+	eeprom_update_byte(OTA_EE_FLAG, OTA_FLAG_UPDATE);
+	eeprom_busy_wait();
+
+	cli();
+	wdt_enable(WDTO_15MS);
+	while (1);
+}
+
+/**
+ * Surveys the candidate channels and moves to the quietest one, if it is
+ * clearly quieter than the current one and the gateway acknowledged the move.
+ */
+void selectChannel() {
+	uint8_t busy[sizeof(radio_channels)];
+	uint8_t current = radio.getChannel();
+	uint8_t current_busy = CHANNEL_SURVEY_ROUNDS;
+
+	radio.powerUp();
+	uint8_t best = radio.surveyChannels(radio_channels, sizeof(radio_channels), CHANNEL_SURVEY_ROUNDS, busy);
+
+	for (uint8_t i = 0; i < sizeof(radio_channels); i++) {
+		log_debug(APP, "channel %d busy %d/%d", radio_channels[i], busy[i], CHANNEL_SURVEY_ROUNDS);
+		if (radio_channels[i] == current) {
+			current_busy = busy[i];
+		}
+	}
+
+	for (uint8_t i = 0; i < sizeof(radio_channels); i++) {
+		if (radio_channels[i] == best && busy[i] + CHANNEL_SWITCH_MARGIN <= current_busy) {
+			uint8_t msg[] = {100, 1, CHANNEL_MSG_TYPE, best};
+			if (sendPacket(msg, sizeof msg)) {
+				radio.setChannel(best);
+				trace(TRACE_CHANNEL, best);
+				log_info(APP, "moved to channel %d", best);
+			}
+		}
+	}
+
+	radio.powerDown();
+}
+
 void readAndSendTemperatureOld() {
 	// read temperature from DS1820 sensor
     float temp = ds1820_read_temp(DS1820_pin);
@@ -206,15 +887,14 @@ void readAndSendTemperatureOld() {
     uint8_t temp_low = (uint8_t) temp_int;
     uint8_t temp_high = (uint8_t) (temp_int>>8);
 
-    debug_print("temp_int=%d", temp_int);
-    debug_print("temp_high=%d", temp_high);
-    debug_print("temp_low=%d", temp_low);
+    log_debug(APP, "temp_int=%d", temp_int);
+    log_debug(APP, "temp_high=%d", temp_high);
+    log_debug(APP, "temp_low=%d", temp_low);
 
     //int16_t temp_int_rec = (int16_t) (((temp_high & 0x00FF) << 8) | (temp_low & 0x00FF));
-    //debug_print("temp_int_rec=%d", temp_int_rec);
+    //log_debug(APP, "temp_int_rec=%d", temp_int_rec);
 
     radio.powerUp();
-    _delay_ms(50);
 
     // Send temperature via NRF24L01 transceiver
 	uint8_t data[] = {100, 1, temp_high, temp_low};
@@ -230,11 +910,11 @@ void readAndSendTemperatureOld() {
 }
 
 void handle_usart_cmd(char *cmd, char *args) {
-	if (strcmp(cmd, "test") == 0) {
-		printf("\n TEST [%s]", args);
+	if (strcmp_P(cmd, PSTR("test")) == 0) {
+		printf_P(PSTR("\n TEST [%s]"), args);
 	}
 
-	if (strcmp(cmd, "read") == 0) {
+	if (strcmp_P(cmd, PSTR("read")) == 0) {
 		if (dht.read()) {
 			// Reading temperature or humidity takes about 250 milliseconds!
 			// Sensor readings may also be up to 2 seconds 'old' (its a very slow sensor)
@@ -249,20 +929,71 @@ void handle_usart_cmd(char *cmd, char *args) {
 			// Compute heat index in Celsius (isFahreheit = false)
 			double hic = dht.computeHeatIndex(t, h, false);
 
-			debug_print("Humidity: %f", h);
-			debug_print("Temperature: %f *C, %f *F", t, f);
-			debug_print("Heat index: %f *C, %f *F", hic, hif);
+			log_info(APP, "Humidity: %f", h);
+			log_info(APP, "Temperature: %f *C, %f *F", t, f);
+			log_info(APP, "Heat index: %f *C, %f *F", hic, hif);
 		} else {
-			debug_print("ERROR reading data");
+			log_error(APP, "ERROR reading data");
 		}
 	}
 
-	if (strcmp(cmd, "read2") == 0) {
+	if (strcmp_P(cmd, PSTR("read2")) == 0) {
 		double temp = (double) ds1820_read_temp(DS1820_pin);
-		debug_print("temp=%f", temp);
+		log_info(APP, "temp=%f", temp);
 	}
 
-	if (strcmp(cmd, "send") == 0) {
+	if (strcmp_P(cmd, PSTR("send")) == 0) {
 		readAndSendTemperature();
 	}
+
+	if (strcmp_P(cmd, PSTR("batch")) == 0) {
+		printf_P(PSTR("\n batched=%d"), batch_count());
+		if (batch_count()) {
+			sendBatch();
+			// acknowledged samples leave the ring, the rest wait for the next send
+			printf_P(PSTR(" left=%d"), batch_count());
+		}
+		printf_P(PSTR("\r\n"));
+	}
+
+	if (strcmp_P(cmd, PSTR("survey")) == 0) {
+		selectChannel();
+	}
+
+	if (strcmp_P(cmd, PSTR("trace")) == 0) {
+		trace_dump(usart_putchar);
+	}
+
+	if (strcmp_P(cmd, PSTR("link")) == 0) {
+		printf_P(PSTR("\n PA=%d ARD=%d ARC avg=%d/16\r\n"), radio_link.getPALevel(), radio_link.getRetryDelay(), radio_link.getAverageRetries());
+		link_stats.print();
+	}
+
+#if SEAL_FRAMES
+	// Time to seal a full frame, against SEAL_BUDGET_US.  The frames never
+	// leave the node, reusing counters here gives nothing away.
+	if (strcmp_P(cmd, PSTR("seal")) == 0) {
+		uint8_t frame[RF24_MAX_PAYLOAD] = {100, 1, BATCH_MSG_TYPE};
+		uint64_t start = getCurrentTimeCicles();
+
+		for (uint8_t i = 0; i < 100; i++) {
+			frame[2] = BATCH_MSG_TYPE;
+			seal(&seal_key, frame, UPLINK_MAX_LEN, i);
+		}
+		uint32_t us = getElapsedMilliseconds(start) * 10;
+		printf_P(PSTR("\n seal: %lu us per frame, budget %d us\r\n"), us, SEAL_BUDGET_US);
+	}
+#endif
+
+#if OTA_UPDATES
+	if (strcmp_P(cmd, PSTR("ota")) == 0) {
+		enterBootloader();
+	}
+#endif
+
+#if RF24_INSTRUMENT
+	if (strcmp_P(cmd, PSTR("stats")) == 0) {
+		radio.printStats();
+	}
+#endif
 }